@@ -0,0 +1,119 @@
+#include "Adaptive.h"
+
+// allocate adaptive anti-aliasing storage big enough for one tile
+void createAdaptiveBuffer(AdaptiveBuffer* adaptive, unsigned int blockSize)
+{
+	adaptive->pixelCapacity = blockSize * blockSize;
+	adaptive->firstSample = new Colour[adaptive->pixelCapacity];
+	adaptive->toneMapped = new Colour[adaptive->pixelCapacity];
+}
+
+
+// free adaptive anti-aliasing storage
+void destroyAdaptiveBuffer(AdaptiveBuffer* adaptive)
+{
+	delete[] adaptive->firstSample;
+	delete[] adaptive->toneMapped;
+}
+
+
+// largest difference in any colour channel between two tone mapped colours
+static float getContrast(const Colour& c1, const Colour& c2)
+{
+	return std::max(std::max(fabsf(c1.red - c2.red), fabsf(c1.green - c2.green)), fabsf(c1.blue - c2.blue));
+}
+
+
+// render a single tile with one sample per pixel, then take the rest of the samples only for pixels that differ from their neighbours
+// (within the tile) by more than the contrast threshold; refined pixels come out the same as with full anti-aliasing
+unsigned int renderTileAdaptive(const Scene* scene, const Camera* camera, const RenderOptions* options, const Tile* tile, int threadId, AdaptiveBuffer* adaptive)
+{
+	const int tileWidth = tile->endX - tile->startX, tileHeight = tile->endY - tile->startY;
+	const SamplePattern* pattern = &options->samplePattern;
+	const float sampleRatio = 1.0f / pattern->samplesPerPixel;
+	unsigned int rays = 0;
+
+	// first pass: the first sample of each pixel (the one the full sample loops start with)
+	// the regular pattern's first sample is at the pixel's corner, so its rays can be generated a row at a time
+	const bool rowRays = pattern->type == SamplePattern::REGULAR;
+	float dirX[CAMERA_ROW_BATCH], dirY[CAMERA_ROW_BATCH], dirZ[CAMERA_ROW_BATCH];
+
+	for (int ty = 0; ty < tileHeight; ty++)
+	{
+		int y = tile->startY + ty - camera->centreY;
+
+		for (int tx = 0; tx < tileWidth; tx++)
+		{
+			int x = tile->startX + tx - camera->centreX;
+			Ray viewRay;
+
+			if (rowRays)
+			{
+				// generate the rays a batch at a time along the row
+				if (tx % CAMERA_ROW_BATCH == 0) getCameraRowDirections(camera, float(x), float(y), 1.0f, dirX, dirY, dirZ);
+
+				int i = tx % CAMERA_ROW_BATCH;
+				viewRay = { camera->position, { dirX[i], dirY[i], dirZ[i] } };
+			}
+			else
+			{
+				const float* offsetX, * offsetY;
+				getPixelSamples(pattern, x, y, &offsetX, &offsetY);
+				viewRay = getCameraRay(camera, x + offsetX[0], y + offsetY[0]);
+			}
+
+			Colour sample = traceRay(scene, options, viewRay);
+
+			adaptive->firstSample[ty * tileWidth + tx] = sample;
+			adaptive->toneMapped[ty * tileWidth + tx] = sample.applyExposure(scene->exposure);
+			rays++;
+		}
+	}
+
+	// second pass: refine high contrast pixels and write out the tile
+	for (int ty = 0; ty < tileHeight; ty++)
+	{
+		unsigned int* out = buffer + getImageIndex(options, tile->startX, tile->startY + ty);
+		int y = tile->startY + ty - camera->centreY;
+
+		for (int tx = 0; tx < tileWidth; tx++)
+		{
+			int x = tile->startX + tx - camera->centreX;
+			const Colour& centre = adaptive->toneMapped[ty * tileWidth + tx];
+
+			// contrast against the (up to) four neighbours inside the tile
+			float contrast = 0.0f;
+			if (tx > 0) contrast = std::max(contrast, getContrast(centre, adaptive->toneMapped[ty * tileWidth + tx - 1]));
+			if (tx < tileWidth - 1) contrast = std::max(contrast, getContrast(centre, adaptive->toneMapped[ty * tileWidth + tx + 1]));
+			if (ty > 0) contrast = std::max(contrast, getContrast(centre, adaptive->toneMapped[(ty - 1) * tileWidth + tx]));
+			if (ty < tileHeight - 1) contrast = std::max(contrast, getContrast(centre, adaptive->toneMapped[(ty + 1) * tileWidth + tx]));
+
+			Colour output = adaptive->firstSample[ty * tileWidth + tx];
+
+			if (pattern->samplesPerPixel > 1 && contrast > options->adaptiveThreshold)
+			{
+				// same sample loop as the non-adaptive renderer, with the first sample reused rather than traced again
+				const float* offsetX, * offsetY;
+				getPixelSamples(pattern, x, y, &offsetX, &offsetY);
+
+				output = sampleRatio * adaptive->firstSample[ty * tileWidth + tx];
+
+				for (unsigned int s = 1; s < pattern->samplesPerPixel; s++)
+				{
+					output += sampleRatio * traceRay(scene, options, getCameraRay(camera, x + offsetX[s], y + offsetY[s]));
+					rays++;
+				}
+			}
+
+			//color rise processing
+			if (options->colourise) {
+				output.colourise(threadId % 7);
+			}
+
+			// store saturated final colour value in image buffer
+			*out++ = output.convertToPixel(scene->exposure);
+		}
+	}
+
+	return rays;
+}
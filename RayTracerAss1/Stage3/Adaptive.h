@@ -0,0 +1,25 @@
+#ifndef __ADAPTIVE_H
+#define __ADAPTIVE_H
+
+#include "Render.h"
+
+// per tile working space for adaptive anti-aliasing
+typedef struct AdaptiveBuffer
+{
+	unsigned int pixelCapacity;		// maximum number of pixels in a tile
+	Colour* firstSample;			// colour of each pixel's first sample
+	Colour* toneMapped;				// first sample after exposure (what the contrast is measured on)
+} AdaptiveBuffer;
+
+// allocate adaptive anti-aliasing storage big enough for one tile
+void createAdaptiveBuffer(AdaptiveBuffer* adaptive, unsigned int blockSize);
+
+// free adaptive anti-aliasing storage
+void destroyAdaptiveBuffer(AdaptiveBuffer* adaptive);
+
+// render a single tile with one sample per pixel, then take the rest of the samples only for pixels that differ from their neighbours
+// (within the tile) by more than the contrast threshold; refined pixels come out the same as with full anti-aliasing
+// returns the number of primary rays traced
+unsigned int renderTileAdaptive(const Scene* scene, const Camera* camera, const RenderOptions* options, const Tile* tile, int threadId, AdaptiveBuffer* adaptive);
+
+#endif // __ADAPTIVE_H
@@ -0,0 +1,473 @@
+#define NOMINMAX
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#include "Bvh.h"
+#include "Mesh.h"
+#include "CacheFile.h"
+
+#pragma warning(disable: 4996)
+
+// fewest objects a hierarchy is built for (a handful of objects are quicker to test one after another than to walk boxes around)
+const unsigned long long BVH_MIN_OBJECTS = 16;
+
+// split positions tried along each axis
+const unsigned int BVH_BINS = 16;
+
+// most objects put in a leaf (more only when they can't be told apart, or at the maximum depth)
+const unsigned int BVH_MAX_LEAF_OBJECTS = 4;
+
+// cost of visiting a node, relative to testing an object
+const float BVH_TRAVERSAL_COST = 1.0f;
+
+// padding around each node, as a fraction of the largest coordinate in the scene (covers rounding in the ray / box tests)
+const float BVH_BOUNDS_PADDING = 1e-5f;
+
+// bump whenever the layout of the cache, or the way hierarchies are built, changes
+const unsigned int BVH_CACHE_VERSION = 2;
+
+// alignment of the arrays within the cache
+const unsigned long long BVH_CACHE_ALIGNMENT = 64;
+
+// start of a hierarchy's cache file, followed by the node, object and object mesh arrays
+typedef struct BvhCacheHeader
+{
+	char magic[8];						// "RTBVH"
+	unsigned int version;				// BVH_CACHE_VERSION
+	unsigned int nodeSize;				// size of BvhNode (catches layout changes between builds)
+	unsigned long long geometryHash;	// hash of the objects (and builder settings) the hierarchy was built for
+
+	// array sizes, and where each starts in the file
+	unsigned int numNodes, numObjects;
+	unsigned long long nodeOffset, objectOffset, objectMeshOffset;
+} BvhCacheHeader;
+
+static const char BVH_CACHE_MAGIC[8] = "RTBVH";
+
+// box around an object or a group of them
+typedef struct BvhBox
+{
+	Point boundsMin, boundsMax;
+} BvhBox;
+
+// state shared by the recursive build
+typedef struct BvhBuild
+{
+	std::vector<BvhNode> nodes;
+	unsigned int* objects;			// object numbers, reordered as the nodes are split
+	const BvhBox* objectBounds;		// box around each object (by object number)
+	const Point* centroids;			// centre of each object's box
+} BvhBuild;
+
+
+static inline BvhBox emptyBox()
+{
+	BvhBox box = { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+	return box;
+}
+
+static inline void growBox(BvhBox* box, const Point& point)
+{
+	box->boundsMin = Point{ std::min(box->boundsMin.x, point.x), std::min(box->boundsMin.y, point.y), std::min(box->boundsMin.z, point.z) };
+	box->boundsMax = Point{ std::max(box->boundsMax.x, point.x), std::max(box->boundsMax.y, point.y), std::max(box->boundsMax.z, point.z) };
+}
+
+static inline void growBox(BvhBox* box, const BvhBox& other)
+{
+	growBox(box, other.boundsMin);
+	growBox(box, other.boundsMax);
+}
+
+// half the surface area of a box (only ever compared with other boxes, so the factor of two doesn't matter)
+static inline float getHalfArea(const BvhBox& box)
+{
+	if (box.boundsMin.x > box.boundsMax.x) return 0.0f;
+
+	Vector size = box.boundsMax - box.boundsMin;
+	return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+static inline float getAxis(const Point& point, unsigned int axis)
+{
+	return axis == 0 ? point.x : (axis == 1 ? point.y : point.z);
+}
+
+
+// box around each of the scene's objects, numbered as for setIntersectionObject
+static void getObjectBounds(const Scene* scene, BvhBox* bounds)
+{
+	for (unsigned int i = 0; i < scene->numSpheres; ++i)
+	{
+		const Sphere* sphere = &scene->sphereContainer[i];
+		bounds->boundsMin = Point{ sphere->pos.x - sphere->size, sphere->pos.y - sphere->size, sphere->pos.z - sphere->size };
+		bounds->boundsMax = Point{ sphere->pos.x + sphere->size, sphere->pos.y + sphere->size, sphere->pos.z + sphere->size };
+		bounds++;
+	}
+
+	for (unsigned int i = 0; i < scene->numTriangles; ++i)
+	{
+		const Triangle* triangle = &scene->triangleContainer[i];
+		*bounds = emptyBox();
+		growBox(bounds, triangle->p1);
+		growBox(bounds, triangle->p2);
+		growBox(bounds, triangle->p3);
+		bounds++;
+	}
+
+	for (unsigned int m = 0; m < scene->numMeshes; ++m)
+	{
+		const Mesh* mesh = &scene->meshContainer[m];
+		for (unsigned int i = 0; i < mesh->numTriangles; ++i)
+		{
+			const unsigned int* index = &mesh->indices[i * 3];
+			*bounds = emptyBox();
+			growBox(bounds, getMeshVertex(mesh, index[0]));
+			growBox(bounds, getMeshVertex(mesh, index[1]));
+			growBox(bounds, getMeshVertex(mesh, index[2]));
+			bounds++;
+		}
+	}
+}
+
+
+// bin an object's centre falls into along an axis
+static inline unsigned int getBin(float centre, float binMin, float binScale)
+{
+	return std::min((unsigned int)((centre - binMin) * binScale), BVH_BINS - 1);
+}
+
+// fill in a node for a run of objects, splitting it (and building its children) if that's cheaper than testing all the objects
+static void buildNode(BvhBuild* build, unsigned int nodeIndex, unsigned int first, unsigned int count, unsigned int depth)
+{
+	unsigned int* objects = &build->objects[first];
+
+	BvhBox bounds = emptyBox(), centroidBounds = emptyBox();
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		growBox(&bounds, build->objectBounds[objects[i]]);
+		growBox(&centroidBounds, build->centroids[objects[i]]);
+	}
+
+	build->nodes[nodeIndex].boundsMin = bounds.boundsMin;
+	build->nodes[nodeIndex].boundsMax = bounds.boundsMax;
+	build->nodes[nodeIndex].first = first;
+	build->nodes[nodeIndex].count = count;
+
+	if (count <= 1 || depth + 1 >= BVH_MAX_DEPTH) return;
+
+	// find the cheapest split (by the surface area heuristic) between bins of object centres, along any axis
+	float bestCost = FLT_MAX;
+	unsigned int bestAxis = 3, bestSplit = 0;
+
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		float binMin = getAxis(centroidBounds.boundsMin, axis);
+		float extent = getAxis(centroidBounds.boundsMax, axis) - binMin;
+		if (extent <= 0.0f) continue;
+
+		float binScale = BVH_BINS / extent;
+		BvhBox binBounds[BVH_BINS];
+		unsigned int binCounts[BVH_BINS] = { 0 };
+		for (unsigned int b = 0; b < BVH_BINS; ++b)
+			binBounds[b] = emptyBox();
+
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			unsigned int b = getBin(getAxis(build->centroids[objects[i]], axis), binMin, binScale);
+			binCounts[b]++;
+			growBox(&binBounds[b], build->objectBounds[objects[i]]);
+		}
+
+		// cost of everything to the right of each split, then sweep in from the left
+		float rightCosts[BVH_BINS];
+		BvhBox side = emptyBox();
+		unsigned int sideCount = 0;
+		for (unsigned int b = BVH_BINS - 1; b > 0; --b)
+		{
+			growBox(&side, binBounds[b]);
+			sideCount += binCounts[b];
+			rightCosts[b] = sideCount > 0 ? getHalfArea(side) * sideCount : -1.0f;
+		}
+
+		side = emptyBox();
+		sideCount = 0;
+		for (unsigned int b = 0; b < BVH_BINS - 1; ++b)
+		{
+			growBox(&side, binBounds[b]);
+			sideCount += binCounts[b];
+
+			// (both sides need something in them)
+			if (sideCount == 0 || rightCosts[b + 1] < 0.0f) continue;
+
+			float cost = getHalfArea(side) * sideCount + rightCosts[b + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	unsigned int leftCount;
+	if (bestAxis < 3)
+	{
+		float area = getHalfArea(bounds);
+		float splitCost = BVH_TRAVERSAL_COST + (area > 0.0f ? bestCost / area : 0.0f);
+		if (count <= BVH_MAX_LEAF_OBJECTS && splitCost >= (float)count) return;
+
+		float binMin = getAxis(centroidBounds.boundsMin, bestAxis);
+		float binScale = BVH_BINS / (getAxis(centroidBounds.boundsMax, bestAxis) - binMin);
+		const Point* centroids = build->centroids;
+		leftCount = (unsigned int)(std::partition(objects, objects + count, [=](unsigned int object)
+			{ return getBin(getAxis(centroids[object], bestAxis), binMin, binScale) <= bestSplit; }) - objects);
+	}
+	else
+	{
+		// every centre is in the same place, so there's nothing to choose between the objects
+		if (count <= BVH_MAX_LEAF_OBJECTS) return;
+		leftCount = count / 2;
+	}
+
+	unsigned int children = (unsigned int)build->nodes.size();
+	build->nodes.resize(children + 2);
+	build->nodes[nodeIndex].first = children;
+	build->nodes[nodeIndex].count = 0;
+
+	buildNode(build, children, first, leftCount, depth + 1);
+	buildNode(build, children + 1, first + leftCount, count - leftCount, depth + 1);
+}
+
+
+// hash of the shapes of the scene's objects (not their materials), and the settings hierarchies are built with
+static unsigned long long hashGeometry(const Scene* scene)
+{
+	const unsigned int settings[6] = { BVH_CACHE_VERSION, BVH_BINS, BVH_MAX_LEAF_OBJECTS, BVH_MAX_DEPTH, (unsigned int)sizeof(BvhNode), scene->numMeshes };
+	const float costs[2] = { BVH_TRAVERSAL_COST, BVH_BOUNDS_PADDING };
+
+	unsigned long long hash = fnv1a(FNV1A_OFFSET_BASIS, settings, sizeof(settings));
+	hash = fnv1a(hash, costs, sizeof(costs));
+
+	hash = fnv1a(hash, &scene->numSpheres, sizeof(scene->numSpheres));
+	for (unsigned int i = 0; i < scene->numSpheres; ++i)
+	{
+		hash = fnv1a(hash, &scene->sphereContainer[i].pos, sizeof(Point));
+		hash = fnv1a(hash, &scene->sphereContainer[i].size, sizeof(float));
+	}
+
+	hash = fnv1a(hash, &scene->numTriangles, sizeof(scene->numTriangles));
+	for (unsigned int i = 0; i < scene->numTriangles; ++i)
+	{
+		const Point corners[3] = { scene->triangleContainer[i].p1, scene->triangleContainer[i].p2, scene->triangleContainer[i].p3 };
+		hash = fnv1a(hash, corners, sizeof(corners));
+	}
+
+	for (unsigned int m = 0; m < scene->numMeshes; ++m)
+	{
+		const Mesh* mesh = &scene->meshContainer[m];
+		const unsigned int counts[3] = { mesh->numVertices, mesh->numTriangles, mesh->quantized != NULL };
+		hash = fnv1a(hash, counts, sizeof(counts));
+
+		if (mesh->quantized != NULL)
+		{
+			hash = fnv1a(hash, &mesh->origin, sizeof(Point));
+			hash = fnv1a(hash, &mesh->step, sizeof(Vector));
+			hash = fnv1a(hash, mesh->quantized, (size_t)mesh->numVertices * 3 * sizeof(unsigned short));
+		}
+		else
+		{
+			hash = fnv1a(hash, mesh->vertices, (size_t)mesh->numVertices * sizeof(Point));
+		}
+		hash = fnv1a(hash, mesh->indices, (size_t)mesh->numTriangles * 3 * sizeof(unsigned int));
+	}
+
+	return hash;
+}
+
+
+// number of objects in the scene, or 0 if there are too few (or too many) for a hierarchy
+static unsigned long long countObjects(const Scene* scene)
+{
+	unsigned long long numObjects = (unsigned long long)scene->numSpheres + scene->numTriangles;
+	for (unsigned int m = 0; m < scene->numMeshes; ++m)
+		numObjects += scene->meshContainer[m].numTriangles;
+
+	// object numbers have to fit in an int (see objectIntersectionBatch)
+	return (numObjects >= BVH_MIN_OBJECTS && numObjects <= 0x7FFFFFFFull) ? numObjects : 0;
+}
+
+
+// build a hierarchy over the scene's objects
+void buildBvh(Scene* scene)
+{
+	destroyBvh(scene);
+
+	unsigned long long numObjects = countObjects(scene);
+	if (numObjects == 0) return;
+
+	BvhBuild build;
+	BvhBox* objectBounds = new BvhBox[numObjects];
+	Point* centroids = new Point[numObjects];
+	getObjectBounds(scene, objectBounds);
+
+	for (unsigned int i = 0; i < numObjects; ++i)
+		centroids[i] = objectBounds[i].boundsMin + (objectBounds[i].boundsMax - objectBounds[i].boundsMin) * 0.5f;
+
+	Bvh* bvh = new Bvh;
+	bvh->numObjects = (unsigned int)numObjects;
+	bvh->objects = new unsigned int[numObjects];
+	for (unsigned int i = 0; i < numObjects; ++i)
+		bvh->objects[i] = i;
+
+	build.objects = bvh->objects;
+	build.objectBounds = objectBounds;
+	build.centroids = centroids;
+	build.nodes.reserve((size_t)numObjects * 2 / BVH_MAX_LEAF_OBJECTS + 1);
+	build.nodes.resize(1);
+	buildNode(&build, 0, 0, bvh->numObjects, 0);
+
+	delete[] objectBounds;
+	delete[] centroids;
+
+	// the mesh holding each of the meshes' triangles, looked up once here rather than every time the triangle is tested
+	const unsigned int firstMeshObject = scene->numSpheres + scene->numTriangles;
+	bvh->objectMeshes = new unsigned int[numObjects];
+	for (unsigned int i = 0; i < numObjects; ++i)
+	{
+		bvh->objectMeshes[i] = 0;
+		if (bvh->objects[i] < firstMeshObject) continue;
+
+		unsigned int triangle = bvh->objects[i] - firstMeshObject;
+		bvh->objectMeshes[i] = (unsigned int)(findMeshTriangle(scene, &triangle) - scene->meshContainer);
+	}
+
+	// pad every box by an amount big enough to cover any rounding in the ray / box tests
+	const BvhNode& root = build.nodes[0];
+	float largest = std::max(std::max(std::max(fabsf(root.boundsMin.x), fabsf(root.boundsMin.y)), std::max(fabsf(root.boundsMin.z), fabsf(root.boundsMax.x))),
+		std::max(fabsf(root.boundsMax.y), fabsf(root.boundsMax.z)));
+	Vector padding = { largest * BVH_BOUNDS_PADDING, largest * BVH_BOUNDS_PADDING, largest * BVH_BOUNDS_PADDING };
+
+	bvh->numNodes = (unsigned int)build.nodes.size();
+	bvh->nodes = new BvhNode[bvh->numNodes];
+	for (unsigned int i = 0; i < bvh->numNodes; ++i)
+	{
+		bvh->nodes[i] = build.nodes[i];
+		bvh->nodes[i].boundsMin = bvh->nodes[i].boundsMin - padding;
+		bvh->nodes[i].boundsMax = bvh->nodes[i].boundsMax + padding;
+	}
+
+	bvh->geometryHash = hashGeometry(scene);
+	bvh->cacheView = NULL;
+	scene->bvh = bvh;
+}
+
+
+// header for a hierarchy, with the arrays laid out one after another
+static void fillHeader(unsigned long long geometryHash, unsigned int numNodes, unsigned int numObjects, BvhCacheHeader* header)
+{
+	memset(header, 0, sizeof(BvhCacheHeader));
+	memcpy(header->magic, BVH_CACHE_MAGIC, sizeof(header->magic));
+	header->version = BVH_CACHE_VERSION;
+	header->nodeSize = sizeof(BvhNode);
+	header->geometryHash = geometryHash;
+	header->numNodes = numNodes;
+	header->numObjects = numObjects;
+
+	const unsigned long long mask = BVH_CACHE_ALIGNMENT - 1;
+	header->nodeOffset = (sizeof(BvhCacheHeader) + mask) & ~mask;
+	header->objectOffset = (header->nodeOffset + (unsigned long long)numNodes * sizeof(BvhNode) + mask) & ~mask;
+	header->objectMeshOffset = (header->objectOffset + (unsigned long long)numObjects * sizeof(unsigned int) + mask) & ~mask;
+}
+
+
+// load the scene's hierarchy from its cache, if there is one and it was built over exactly the objects the scene has now
+bool loadBvhCache(const char* inputName, Scene* scene)
+{
+	destroyBvh(scene);
+	if (countObjects(scene) == 0) return false;
+
+	char cacheName[1024];
+	getCacheName(inputName, BVH_CACHE_EXTENSION, cacheName, sizeof(cacheName));
+
+	// nothing in the hierarchy needs patching, so it's used straight from a read only mapping
+	unsigned long long fileSize;
+	const char* view = mapFile(cacheName, false, &fileSize);
+	if (view == NULL) return false;
+	if (fileSize < sizeof(BvhCacheHeader))
+	{
+		UnmapViewOfFile(view);
+		return false;
+	}
+
+	// the cache has to have been built over the same objects (with the same settings), and the layout has to match this build
+	const BvhCacheHeader* header = (const BvhCacheHeader*)view;
+	BvhCacheHeader expected;
+	fillHeader(hashGeometry(scene), header->numNodes, header->numObjects, &expected);
+
+	if (memcmp(header, &expected, sizeof(expected)) != 0 || header->numNodes == 0
+		|| fileSize < expected.objectMeshOffset + (unsigned long long)header->numObjects * sizeof(unsigned int))
+	{
+		UnmapViewOfFile(view);
+		return false;
+	}
+
+	Bvh* bvh = new Bvh;
+	bvh->numNodes = header->numNodes;
+	bvh->numObjects = header->numObjects;
+	bvh->nodes = (BvhNode*)(view + header->nodeOffset);
+	bvh->objects = (unsigned int*)(view + header->objectOffset);
+	bvh->objectMeshes = (unsigned int*)(view + header->objectMeshOffset);
+	bvh->geometryHash = header->geometryHash;
+	bvh->cacheView = (void*)view;
+	scene->bvh = bvh;
+
+	return true;
+}
+
+
+// write the cache of a hierarchy which has just been built
+bool saveBvhCache(const char* inputName, const Scene* scene)
+{
+	const Bvh* bvh = scene->bvh;
+	if (bvh == NULL) return true;
+
+	BvhCacheHeader header;
+	fillHeader(bvh->geometryHash, bvh->numNodes, bvh->numObjects, &header);
+
+	char cacheName[1024];
+	getCacheName(inputName, BVH_CACHE_EXTENSION, cacheName, sizeof(cacheName));
+
+	const void* blocks[3] = { bvh->nodes, bvh->objects, bvh->objectMeshes };
+	const unsigned long long offsets[3] = { header.nodeOffset, header.objectOffset, header.objectMeshOffset };
+	const unsigned long long sizes[3] = { (unsigned long long)bvh->numNodes * sizeof(BvhNode), (unsigned long long)bvh->numObjects * sizeof(unsigned int),
+		(unsigned long long)bvh->numObjects * sizeof(unsigned int) };
+
+	return writeCacheFile(cacheName, &header, sizeof(header), 3, blocks, offsets, sizes);
+}
+
+
+// free the scene's hierarchy
+void destroyBvh(Scene* scene)
+{
+	if (scene->bvh == NULL) return;
+
+	Bvh* bvh = scene->bvh;
+	if (bvh->cacheView != NULL)
+	{
+		UnmapViewOfFile(bvh->cacheView);
+	}
+	else
+	{
+		delete[] bvh->nodes;
+		delete[] bvh->objects;
+		delete[] bvh->objectMeshes;
+	}
+
+	delete bvh;
+	scene->bvh = NULL;
+}
@@ -0,0 +1,51 @@
+#ifndef __BVH_H
+#define __BVH_H
+
+#include "Scene.h"
+
+// bounding volume hierarchies are cached next to their scene's text file, with this appended to the name
+#define BVH_CACHE_EXTENSION ".rtbvh"
+
+// deepest a hierarchy is built (and so the most nodes a traversal has waiting on its stack)
+#define BVH_MAX_DEPTH 64
+
+// node of a bounding volume hierarchy (32 bytes, so two to a cache line)
+typedef struct BvhNode
+{
+	Point boundsMin;			// box around everything below the node (padded very slightly, so rays grazing it aren't missed)
+	unsigned int first;			// first child for interior nodes (the second one follows it), or first of the leaf's objects
+	Point boundsMax;
+	unsigned int count;			// number of objects in a leaf, 0 for interior nodes
+} BvhNode;
+
+// bounding volume hierarchy over all of a scene's objects
+typedef struct Bvh
+{
+	unsigned int numNodes;
+	unsigned int numObjects;
+	BvhNode* nodes;				// root first
+	unsigned int* objects;		// object numbers (see setIntersectionObject), the objects of each leaf together
+	unsigned int* objectMeshes;	// mesh each of the objects belongs to (only set for the triangles of meshes), so it needn't be searched for
+
+	unsigned long long geometryHash;	// hash of the objects' shapes and the builder's settings
+	void* cacheView;			// mapping of the cache file the arrays point into (NULL when built, in which case they're allocated with new[])
+} Bvh;
+
+// build a hierarchy over the scene's objects (binned surface area heuristic), does nothing for scenes with only a few objects
+// the hierarchy is only valid until the objects change (e.g. with indexSceneTriangles or quantizeMesh)
+// it's allocated apart from the scene's arena, so a watched scene can be rebuilt any number of times without the arena growing
+void buildBvh(Scene* scene);
+
+// load the scene's hierarchy from its cache, if there is one and it was built over exactly the objects the scene has now
+// the hierarchy's arrays point straight into a (read only) mapping of the cache file
+// returns false if the cache is missing or out of date
+bool loadBvhCache(const char* inputName, Scene* scene);
+
+// write the cache of a hierarchy which has just been built
+// returns false if the cache couldn't be written
+bool saveBvhCache(const char* inputName, const Scene* scene);
+
+// free the scene's hierarchy (the scene goes back to testing every object against every ray)
+void destroyBvh(Scene* scene);
+
+#endif // __BVH_H
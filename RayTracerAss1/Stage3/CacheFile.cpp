@@ -0,0 +1,89 @@
+#define NOMINMAX
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "CacheFile.h"
+
+#pragma warning(disable: 4996)
+
+
+// mix a block of memory into a 64 bit FNV-1a hash
+unsigned long long fnv1a(unsigned long long hash, const void* data, size_t bytes)
+{
+	const unsigned char* p = (const unsigned char*)data;
+
+	for (; bytes >= 4; bytes -= 4, p += 4)
+	{
+		unsigned int word;
+		memcpy(&word, p, sizeof(word));
+		hash = (hash ^ word) * 1099511628211ull;
+	}
+	for (; bytes > 0; --bytes)
+		hash = (hash ^ *p++) * 1099511628211ull;
+
+	return hash;
+}
+
+
+// map a whole file
+const char* mapFile(const char* fileName, bool copyOnWrite, unsigned long long* size)
+{
+	HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return NULL;
+
+	LARGE_INTEGER fileSize;
+	HANDLE mapping = NULL;
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+	{
+		mapping = CreateFileMappingA(file, NULL, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+	}
+	CloseHandle(file);
+	if (mapping == NULL) return NULL;
+
+	const char* view = (const char*)MapViewOfFile(mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+
+	*size = (unsigned long long)fileSize.QuadPart;
+	return view;
+}
+
+
+// name of the cache kept next to a file
+void getCacheName(const char* inputName, const char* extension, char* cacheName, size_t size)
+{
+	snprintf(cacheName, size, "%s%s", inputName, extension);
+}
+
+
+// write a cache file
+bool writeCacheFile(const char* cacheName, const void* header, size_t headerSize,
+	unsigned int numBlocks, const void* const* blocks, const unsigned long long* offsets, const unsigned long long* sizes)
+{
+	FILE* file = fopen(cacheName, "wb");
+	if (file == NULL) return false;
+
+	const char padding[256] = { 0 };
+	bool written = fwrite(header, headerSize, 1, file) == 1;
+	unsigned long long position = headerSize;
+
+	for (unsigned int i = 0; i < numBlocks && written; ++i)
+	{
+		while (written && position < offsets[i])
+		{
+			size_t gap = (size_t)std::min(offsets[i] - position, (unsigned long long)sizeof(padding));
+			written = fwrite(padding, 1, gap, file) == gap;
+			position += gap;
+		}
+		if (written && sizes[i] > 0) written = fwrite(blocks[i], 1, size_t(sizes[i]), file) == sizes[i];
+		position += sizes[i];
+	}
+
+	written = fclose(file) == 0 && written;
+
+	// don't leave a broken cache behind
+	if (!written) remove(cacheName);
+
+	return written;
+}
@@ -0,0 +1,26 @@
+#ifndef __CACHE_FILE_H
+#define __CACHE_FILE_H
+
+#include <stddef.h>
+
+// starting value of a 64 bit FNV-1a hash
+#define FNV1A_OFFSET_BASIS 14695981039346656037ull
+
+// mix a block of memory into a 64 bit FNV-1a hash, a 32 bit word at a time (so even big meshes hash quickly), then any bytes left over
+// hashes are only comparable between blocks mixed in with the same sizes
+unsigned long long fnv1a(unsigned long long hash, const void* data, size_t bytes);
+
+// map a whole file, read only or copy on write (so it can be patched without touching the file)
+// returns NULL if it can't be read (or is empty), and sets the size of the file otherwise
+// the view is freed with UnmapViewOfFile
+const char* mapFile(const char* fileName, bool copyOnWrite, unsigned long long* size);
+
+// name of the cache kept next to a file (the file's name with the cache's extension appended)
+void getCacheName(const char* inputName, const char* extension, char* cacheName, size_t size);
+
+// write a cache file: its header, then each of the blocks at its offset (after the header, in order), padding the gaps with zeros
+// returns false if the file couldn't all be written, in which case it's removed rather than left behind broken
+bool writeCacheFile(const char* cacheName, const void* header, size_t headerSize,
+	unsigned int numBlocks, const void* const* blocks, const unsigned long long* offsets, const unsigned long long* sizes);
+
+#endif // __CACHE_FILE_H
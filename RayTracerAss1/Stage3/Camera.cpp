@@ -0,0 +1,54 @@
+#include "Camera.h"
+
+// set up the camera for rendering the scene at the given image size
+void createCamera(Camera* camera, const Scene* scene, int width, int height)
+{
+	// angle between each successive ray cast (per pixel, anti-aliasing uses a fraction of this)
+	float dirStepSize = 1.0f / (0.5f * width / tanf(PIOVER180 * 0.5f * scene->cameraFieldOfView));
+
+	float cosRotation = cosf(scene->cameraRotation), sinRotation = sinf(scene->cameraRotation);
+
+	// camera looks down z, rotated around y
+	camera->position = scene->cameraPosition;
+	camera->forward = { -sinRotation, 0.0f, cosRotation };
+	camera->right = { dirStepSize * cosRotation, 0.0f, dirStepSize * sinRotation };
+	camera->up = { 0.0f, dirStepSize, 0.0f };
+	camera->centreX = width / 2;
+	camera->centreY = height / 2;
+}
+
+
+// primary ray through the given (sub-)pixel location, relative to the centre of the image
+Ray getCameraRay(const Camera* camera, float fragmentx, float fragmenty)
+{
+	Vector dir = {
+		camera->forward.x + camera->right.x * fragmentx,
+		camera->forward.y + camera->up.y * fragmenty,
+		camera->forward.z + camera->right.z * fragmentx };
+
+	Ray viewRay = { camera->position, normalise(dir) };
+
+	return viewRay;
+}
+
+
+// normalised directions of CAMERA_ROW_BATCH primary rays along a row, starting at the given location and stepping across by the given amount
+// written as one straight loop (the same sums as getCameraRay) so it vectorises
+void getCameraRowDirections(const Camera* camera, float fragmentx, float fragmenty, float step, float* dirX, float* dirY, float* dirZ)
+{
+	// the height of the row is the same for the whole batch
+	const float rowY = camera->forward.y + camera->up.y * fragmenty;
+
+	for (int i = 0; i < CAMERA_ROW_BATCH; ++i)
+	{
+		float x = fragmentx + i * step;
+
+		float dx = camera->forward.x + camera->right.x * x;
+		float dz = camera->forward.z + camera->right.z * x;
+		float invLength = 1.0f / sqrtf(dx * dx + rowY * rowY + dz * dz);
+
+		dirX[i] = dx * invLength;
+		dirY[i] = rowY * invLength;
+		dirZ[i] = dz * invLength;
+	}
+}
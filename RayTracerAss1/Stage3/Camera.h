@@ -0,0 +1,32 @@
+#ifndef __CAMERA_H
+#define __CAMERA_H
+
+#include "Scene.h"
+
+// number of ray directions generated at once along a row of the image
+const int CAMERA_ROW_BATCH = 16;
+
+// camera basis for one frame, worked out once so rays don't need any trigonometry
+// rays are given in fragment coordinates, which are pixel positions relative to the centre pixel of the full image,
+// so any part of the image (e.g. an off-centre crop window) gets the same rays as it would in the full render
+typedef struct Camera
+{
+	Point position;				// camera location
+	Vector forward;				// direction through the centre of the image (before normalising)
+	Vector right;				// change in direction per pixel across the image
+	Vector up;					// change in direction per pixel down the image
+	int centreX, centreY;		// pixel at the centre of the image
+} Camera;
+
+// set up the camera for rendering the scene at the given image size
+// pixels are square, so the field of view covers the width and the height follows from the aspect ratio
+void createCamera(Camera* camera, const Scene* scene, int width, int height);
+
+// primary ray through the given (sub-)pixel location, relative to the centre of the image
+Ray getCameraRay(const Camera* camera, float fragmentx, float fragmenty);
+
+// normalised directions of CAMERA_ROW_BATCH primary rays along a row, starting at the given location and stepping across by the given amount
+// the results are the same as calling getCameraRay for each location
+void getCameraRowDirections(const Camera* camera, float fragmentx, float fragmenty, float step, float* dirX, float* dirY, float* dirZ);
+
+#endif // __CAMERA_H
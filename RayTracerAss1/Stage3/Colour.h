@@ -36,6 +36,12 @@ struct Colour
 			((unsigned char) (255 * (std::min(1.0f - expf(red * exposure), 1.0f))) << 0);
 	}
 
+	// colour after exposure, with each channel from 0 to 1 (as convertToPixel works out before rounding)
+	inline Colour applyExposure(float exposure) const
+	{
+		return Colour(std::min(1.0f - expf(red * exposure), 1.0f), std::min(1.0f - expf(green * exposure), 1.0f), std::min(1.0f - expf(blue * exposure), 1.0f));
+	}
+
 	// colour += colour
 	inline Colour& operator += (const Colour& c2) 
 	{
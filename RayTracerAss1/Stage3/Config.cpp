@@ -7,11 +7,11 @@
 // THIS FILE DOES NOT FOLLOW THE SAME FORMATTING CONVENTIONS AS THE REST OF THIS PROJECT
 
 #include <cmath>
-#include <fstream>
-#include <map>
-#include <set>
-#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
 #include "Config.h"
+#include "CacheFile.h"
 
 #pragma warning(push)
 #pragma warning(disable:4996)
@@ -19,159 +19,216 @@
 // This is a simple config file parser.
 // It does what we need no more no less.
 
-typedef std::map<SimpleString,SimpleString> VariableSet;
-typedef std::set<SimpleString> StringSet;
-
-static SimpleString preprocess(std::fstream& InputFile) {
-    SimpleString tmp;
-	std::string line;
-    while (getline(InputFile,line, '\n')) {
-        // Get rid of C-Style comments 
-        line = line.substr(0,line.find("//"));
-        // Get rid of spaces/tabs/newlines. The basic syntax allows us to do that obviously.
-		for (std::string::iterator i = line.begin(); i != line.end(); ++i) {
-            switch (*i) {
-            case ' ':case '\t': case '\n': case '\r':
+// The file is read into memory in one go and scanned once. Spaces and comments are squeezed out
+// in place, so every name and value ends up as a null terminated string inside the buffer.
+// Numbers are converted straight from the buffer when they are asked for.
+
+struct ConfigKey {
+    int section;            // section the variable is in (-1 for the section names themselves)
+    const char* name;
+    unsigned int hash;
+    const char* value;      // value of the variable (for sections, the end of their squeezed contents)
+};
+
+// open addressing hash table of keys, the first key inserted under a name wins
+class ConfigTable {
+private:
+    std::vector<ConfigKey> m_Keys;
+    std::vector<int> m_Slots;       // index into m_Keys, or -1 for an empty slot
+
+    static unsigned int Hash(int section, const char* name) {
+        return unsigned(fnv1a(fnv1a(FNV1A_OFFSET_BASIS, &section, sizeof(section)), name, strlen(name)));
+    }
+
+    void Grow() {
+        m_Slots.assign(m_Slots.empty() ? 64 : m_Slots.size() * 2, -1);
+        for (size_t k = 0; k < m_Keys.size(); ++k) {
+            size_t mask = m_Slots.size() - 1;
+            size_t slot = m_Keys[k].hash & mask;
+            while (m_Slots[slot] != -1) slot = (slot + 1) & mask;
+            m_Slots[slot] = int(k);
+        }
+    }
+
+public:
+    // returns false if the key is already in the table
+    bool Insert(int section, const char* name, const char* value) {
+        if ((m_Keys.size() + 1) * 2 > m_Slots.size()) Grow();
+        unsigned int hash = Hash(section, name);
+        size_t mask = m_Slots.size() - 1;
+        size_t slot = hash & mask;
+        for (; m_Slots[slot] != -1; slot = (slot + 1) & mask) {
+            const ConfigKey& key = m_Keys[m_Slots[slot]];
+            if (key.hash == hash && key.section == section && strcmp(key.name, name) == 0) return false;
+        }
+        ConfigKey key = { section, name, hash, value };
+        m_Slots[slot] = int(m_Keys.size());
+        m_Keys.push_back(key);
+        return true;
+    }
+
+    // keys are numbered in the order they were inserted, returns -1 if the key isn't in the table
+    int Find(int section, const char* name) const {
+        if (m_Slots.empty()) return -1;
+        unsigned int hash = Hash(section, name);
+        size_t mask = m_Slots.size() - 1;
+        for (size_t slot = hash & mask; m_Slots[slot] != -1; slot = (slot + 1) & mask) {
+            const ConfigKey& key = m_Keys[m_Slots[slot]];
+            if (key.hash == hash && key.section == section && strcmp(key.name, name) == 0) return m_Slots[slot];
+        }
+        return -1;
+    }
+
+    const char* Name(int index) const { return m_Keys[index].name; }
+    const char* Value(int index) const { return m_Keys[index].value; }
+    void SetValue(int index, const char* value) { m_Keys[index].value = value; }
+
+    int Size() const { return int(m_Keys.size()); }
+};
+
+// next character that matters (skipping spaces, tabs, newlines and C++ style comments), or -1 at the end of the file
+static int nextChar(const char*& i, const char* end) {
+    while (i != end) {
+        char c = *i++;
+        switch (c) {
+        case ' ': case '\t': case '\n': case '\r':
+            break;
+        case '/':
+            if (i != end && *i == '/') {
+                while (i != end && *i != '\n') ++i;
                 break;
-            default:
-              tmp.append(*i);
             }
+            return c;
+        default:
+            return c;
         }
     }
-    return tmp;
+    return -1;
 }
 
-static bool preload(std::fstream& InputFile, VariableSet &variables, StringSet &sections) {
-    static SimpleString buf;
-    SimpleString tmp;
-    int recursion=0;
-    tmp = preprocess(InputFile);
-    SimpleString::iterator i=tmp.begin();
-    SimpleString tmpname;
-    SimpleString tmpvalue;
-    SimpleString currentSection;
-    
+// scan the file, squeezing names and values down in place (write never gets ahead of read)
+static bool preload(char* buffer, size_t size, ConfigTable &variables, ConfigTable &sections) {
+    const char* read = buffer;
+    const char* end = buffer + size;
+    char* write = buffer;
+    char* tmpname = write;
+    char* tmpvalue = NULL;
+    int recursion = 0;
+    int currentSection = -1;
+    int c;
+
 findname:
-    if (i == tmp.end()) {
+    c = nextChar(read, end);
+    if (c == -1) {
         // We're done
-        goto end;
+        return true;
     }
-    switch (*i) {
+    switch (c) {
     case '{':
-        if (sections.insert(tmpname).second == false) {
+        *write++ = '\0';
+        if (!sections.Insert(-1, tmpname, NULL)) {
             // There is already a section by that name !!
-            sections.clear();
-            variables.clear();
             return false;
         }
-        currentSection = tmpname;
-        tmpname.resize(0);
+        currentSection = sections.Size() - 1;
+        recursion = 1;
+        tmpname = write;
         goto insection;
-        break;
     default:
-        tmpname.append(&*i,1);
+        *write++ = char(c);
     }
-    ++i;
     goto findname;
-        
+
 insection:
-    if (i == tmp.end()) {
-        sections.clear();
-        variables.clear();
+    c = nextChar(read, end);
+    switch (c) {
+    case -1:
         return false;
-    }
-    switch (*i) {
     case '{':
-        ++recursion; 
+        ++recursion;
         break;
     case '}':
         --recursion;
         if (recursion == 0) {
-            ++i;
-            // We finished extracting the variables, don't keep those around
-            currentSection.resize(0);
+            // We finished extracting the variables
+            sections.SetValue(currentSection, write);
+            currentSection = -1;
+            tmpname = write;
             goto findname;
         }
         break;
     default:
+        *write++ = char(c);
         goto variablename;
     }
-    ++i;
     goto insection;
-    
+
 variablename:
-    if (i == tmp.end()) {
-            sections.clear();
-            variables.clear();
+    c = nextChar(read, end);
+    switch (c) {
+    case -1:
+    case '}':
         return false;
-    }
-    switch (*i) {
     case '{':
         // It was not a variable but the start of a new block
+        ++recursion;
         goto insection;
-    case '}':
-            sections.clear();
-            variables.clear();
-        return false;
     case '=':
-        if (tmpname.empty()) {
-            sections.clear();
-            variables.clear();
+        if (write == tmpname) {
             return false;
         }
-        ++i;
+        *write++ = '\0';
+        tmpvalue = write;
         goto variablevalue;
     default:
-        tmpname.append(&*i,1);
+        *write++ = char(c);
         break;
     }
-    ++i;
-    goto variablename;    
-    
+    goto variablename;
+
 variablevalue:
-    if (i == tmp.end()) {
-            sections.clear();
-            variables.clear();
-        return false;
-    }
-    switch (*i) {
+    c = nextChar(read, end);
+    switch (c) {
+    case -1:
     case '{':
-            sections.clear();
-            variables.clear();
-        return false;
     case '}':
-            sections.clear();
-            variables.clear();
         return false;
     case ';':
-        if (tmpvalue.empty()) {
-            sections.clear();
-            variables.clear();
+        if (write == tmpvalue) {
             return false;
         }
-        // We store the variable with the name of the section as a prefix
-        buf.assign(currentSection);
-        buf.append('/');
-        buf.append(tmpname);
-        variables.insert(VariableSet::value_type(buf, tmpvalue));
-        tmpname.resize(0);
-        tmpvalue.resize(0);
-        ++i;
+        *write++ = '\0';
+        variables.Insert(currentSection, tmpname, tmpvalue);
+        tmpname = write;
         goto insection;
     default:
-        tmpvalue.append(i,1);
+        *write++ = char(c);
         break;
     }
-    ++i;
-    goto variablevalue;    
-end:
-    return true;
+    goto variablevalue;
+}
+
+// read up to count comma separated floats, returns the number read (like sscanf with "%f,%f,...")
+static int readFloats(const char* value, float* result, int count) {
+    for (int n = 0; n < count; ++n) {
+        if (n > 0) {
+            if (*value != ',') return n;
+            ++value;
+        }
+        char* next;
+        result[n] = strtof(value, &next);
+        if (next == value) return n;
+        value = next;
+    }
+    return count;
 }
 
 Config::Config(const SimpleString &sFileName) :
 m_pVariables(NULL),
 m_pSections(NULL),
+m_pBuffer(NULL),
 m_sFileName(sFileName),
+m_nCurrentSection(-1),
 m_bLoaded(false)
 {
 }
@@ -179,32 +236,38 @@ m_bLoaded(false)
 Config::~Config()
 {
     if (m_pVariables != NULL)
-        delete static_cast<VariableSet *>(m_pVariables);
+        delete static_cast<ConfigTable *>(m_pVariables);
     if (m_pSections != NULL)
-        delete static_cast<StringSet *>(m_pSections);
+        delete static_cast<ConfigTable *>(m_pSections);
+    delete [] m_pBuffer;
 }
 
-int Config::SetSection(const SimpleString &sName)
+int Config::SetSection(const char* sName)
 {
     if (!m_bLoaded) {
         m_bLoaded = true;
-        m_pVariables = new VariableSet();
-        m_pSections = new StringSet();
-		std::fstream InputFile;
-        bool result;
-		InputFile.open(m_sFileName.c_str(), std::ios::in);
-        if (InputFile.is_open() == 0) {
-            result = false; 
-        } else {
-            result = preload(InputFile, 
-                *(static_cast<VariableSet *>(m_pVariables)),
-                *(static_cast<StringSet *>(m_pSections)));
-            InputFile.close();
+        m_pVariables = new ConfigTable();
+        m_pSections = new ConfigTable();
+        bool result = false;
+        FILE* inputFile = fopen(m_sFileName.c_str(), "rb");
+        if (inputFile != NULL) {
+            fseek(inputFile, 0, SEEK_END);
+            long size = ftell(inputFile);
+            fseek(inputFile, 0, SEEK_SET);
+            if (size >= 0) {
+                m_pBuffer = new char[size_t(size) + 1];
+                size = long(fread(m_pBuffer, 1, size_t(size), inputFile));
+                m_pBuffer[size] = '\0';
+                result = preload(m_pBuffer, size_t(size),
+                    *(static_cast<ConfigTable *>(m_pVariables)),
+                    *(static_cast<ConfigTable *>(m_pSections)));
+            }
+            fclose(inputFile);
         }
         if (!result) {
-            delete static_cast<VariableSet *>(m_pVariables);
+            delete static_cast<ConfigTable *>(m_pVariables);
             m_pVariables = NULL;
-            delete static_cast<StringSet *>(m_pSections);
+            delete static_cast<ConfigTable *>(m_pSections);
             m_pSections = NULL;
             return -1;
         }
@@ -212,110 +275,118 @@ int Config::SetSection(const SimpleString &sName)
     if (m_pVariables == NULL) {
         return -1;
     }
-    StringSet::const_iterator i = 
-        ((StringSet*)m_pSections)->find(sName);
-    if (i != ((StringSet*)m_pSections)->end() ) {
-        m_sCurrentSection.assign(sName).append('/');
+    m_nCurrentSection = static_cast<ConfigTable *>(m_pSections)->Find(-1, sName);
+    if (m_nCurrentSection != -1) {
         return 0;
     } else {
-        m_sCurrentSection.resize(0);
         return -1;
     }
 }
 
-long Config::GetByNameAsInteger(const SimpleString &sName, long lDefaut) const
+int Config::GetSectionCount() const
+{
+    return m_pSections != NULL ? static_cast<ConfigTable *>(m_pSections)->Size() : 0;
+}
+
+const char* Config::GetSectionName(int nSection) const
 {
-    static SimpleString longName;
-    longName.assign(m_sCurrentSection).append(sName);
-    VariableSet::const_iterator i = 
-        ((VariableSet *)m_pVariables)->find(longName);
-    if (i != ((VariableSet *)m_pVariables)->end()) 
-        return atol((*i).second.c_str());
+    return static_cast<ConfigTable *>(m_pSections)->Name(nSection);
+}
+
+unsigned long long Config::GetSectionHash(int nSection) const
+{
+    // hash of the squeezed name and contents (so only edits to the names and values count)
+    const ConfigTable* sections = static_cast<ConfigTable *>(m_pSections);
+    const char* name = sections->Name(nSection);
+    return fnv1a(FNV1A_OFFSET_BASIS, name, size_t(sections->Value(nSection) - name));
+}
+
+// value of a variable in a section (NULL if there isn't one)
+const char* Config::Find(int nSection, const char* sName) const
+{
+    if (m_pVariables == NULL || nSection < 0)
+        return NULL;
+    const ConfigTable* variables = static_cast<ConfigTable *>(m_pVariables);
+    int index = variables->Find(nSection, sName);
+    return index != -1 ? variables->Value(index) : NULL;
+}
+
+long Config::GetByNameAsInteger(const char* sName, long lDefaut) const
+{
+    const char* value = Find(m_nCurrentSection, sName);
+    if (value != NULL)
+        return strtol(value, NULL, 10);
     else {
         return lDefaut;
     }
 }
 
-const SimpleString &Config::GetByNameAsString(const SimpleString &sName, const SimpleString &sDefaut) const
+const char* Config::GetByNameAsString(const char* sName, const char* sDefaut) const
 {
-    static SimpleString longName;
-    longName.assign(m_sCurrentSection).append(sName);
-    VariableSet::const_iterator i = 
-        ((VariableSet *)m_pVariables)->find(longName);
-    if (i != ((VariableSet *)m_pVariables)->end()) 
-        return (*i).second;
+    const char* value = Find(m_nCurrentSection, sName);
+    if (value != NULL)
+        return value;
     else {
         return sDefaut;
     }
 }
 
-double Config::GetByNameAsFloat(const SimpleString &sName, double fDefaut) const
+double Config::GetByNameAsFloat(const char* sName, double fDefaut) const
 {
-    static SimpleString longName;
-    longName.assign(m_sCurrentSection).append(sName);
-    VariableSet::const_iterator i = 
-        static_cast<VariableSet *>(m_pVariables)->find(longName);
-    if (i != ((VariableSet *)m_pVariables)->end()) 
-        return atof((*i).second.c_str());
+    const char* value = Find(m_nCurrentSection, sName);
+    if (value != NULL)
+        return strtod(value, NULL);
     else {
         return fDefaut;
     }
 }
 
-Colour Config::GetByNameAsFloatOrColour(const SimpleString& sName, double fDefaut) const
+Colour Config::GetByNameAsFloatOrColour(const char* sName, double fDefaut) const
 {
-    float fScalar = float(GetByNameAsFloat(sName, 0.0f)); 
-    Vector vColor = { fScalar, fScalar, fScalar };
-    vColor = GetByNameAsVector(sName, vColor);
+    // a single value is a grey, looked up once for both
+    const char* value = Find(m_nCurrentSection, sName);
+    float values[3] = { 0.0f, 0.0f, 0.0f };
+    if (value != NULL && readFloats(value, values, 3) != 3) {
+        values[0] = values[1] = values[2] = float(strtod(value, NULL));
+    }
 
-	return Colour(vColor.x, vColor.y, vColor.z);
+	return Colour(values[0], values[1], values[2]);
 }
 
-bool Config::GetByNameAsBoolean(const SimpleString &sName, bool bDefaut) const
+bool Config::GetByNameAsBoolean(const char* sName, bool bDefaut) const
 {
-    static SimpleString longName;
-    longName.assign(m_sCurrentSection).append(sName);
-    VariableSet::const_iterator i = 
-        static_cast<VariableSet *>(m_pVariables)->find(longName);
-    if (i != ((VariableSet *)m_pVariables)->end()) {
-        return (*i).second.compare("true")==0;
+    const char* value = Find(m_nCurrentSection, sName);
+    if (value != NULL) {
+        return strcmp(value, "true")==0;
     } else {
         return bDefaut;
     }
 }
 
-Vector Config::GetByNameAsVector(const SimpleString &sName, const Vector& vDefault) const
+Vector Config::GetByNameAsVector(const char* sName, const Vector& vDefault) const
 {
-    Vector tempVecteur;
-    static SimpleString longName; 
-    longName.assign(m_sCurrentSection).append(sName);
-    VariableSet::const_iterator i = 
-        static_cast<VariableSet *>(m_pVariables)->find(longName);
-    if (i != ((VariableSet *)m_pVariables)->end()) {
-        int nbRead = sscanf(i->second.c_str(), "%f,%f,%f", &tempVecteur.x, &tempVecteur.y, &tempVecteur.z);
-        if (nbRead != 3) {
+    const char* value = Find(m_nCurrentSection, sName);
+    if (value != NULL) {
+        float values[3];
+        if (readFloats(value, values, 3) != 3) {
             return vDefault;
         }
-        
+        Vector tempVecteur = { values[0], values[1], values[2] };
         return tempVecteur;
     } else {
         return vDefault;
     }
 }
 
-Point Config::GetByNameAsPoint(const SimpleString &sName, const Point& ptDefault) const
+Point Config::GetByNameAsPoint(const char* sName, const Point& ptDefault) const
 {
-    Point tempPoint;
-    static SimpleString longName; 
-    longName.assign(m_sCurrentSection).append(sName);
-    VariableSet::const_iterator i = 
-        static_cast<VariableSet *>(m_pVariables)->find(longName);
-    if (i != ((VariableSet *)m_pVariables)->end()) {
-        int nbRead = sscanf(i->second.c_str(), "%f,%f,%f", &tempPoint.x, &tempPoint.y, &tempPoint.z);
-        if (nbRead != 3) {
+    const char* value = Find(m_nCurrentSection, sName);
+    if (value != NULL) {
+        float values[3];
+        if (readFloats(value, values, 3) != 3) {
             return ptDefault;
         }
-        
+        Point tempPoint = { values[0], values[1], values[2] };
         return tempPoint;
     } else {
         return ptDefault;
@@ -323,22 +394,24 @@ Point Config::GetByNameAsPoint(const SimpleString &sName, const Point& ptDefault
 }
 
 // note, this doesn't completely populate the triangle struct
-Triangle Config::GetByNameAsTriangle(const SimpleString &sName, const Triangle& vDefault) const
+Triangle Config::GetByNameAsTriangle(const char* sName, const Triangle& vDefault) const
+{
+	return GetByNameAsTriangle(m_nCurrentSection, sName, vDefault);
+}
+
+Triangle Config::GetByNameAsTriangle(int nSection, const char* sName, const Triangle& vDefault) const
 {
-	Triangle tempTriangle;
-	static SimpleString longName;
-	longName.assign(m_sCurrentSection).append(sName);
-	VariableSet::const_iterator i =
-		static_cast<VariableSet *>(m_pVariables)->find(longName);
-	if (i != ((VariableSet *)m_pVariables)->end()) {
-		int nbRead = sscanf(i->second.c_str(), "%f,%f,%f,%f,%f,%f,%f,%f,%f", 
-			&tempTriangle.p1.x, &tempTriangle.p1.y, &tempTriangle.p1.z,
-			&tempTriangle.p2.x, &tempTriangle.p2.y, &tempTriangle.p2.z,
-			&tempTriangle.p3.x, &tempTriangle.p3.y, &tempTriangle.p3.z);
-		if (nbRead != 9) {
+	const char* value = Find(nSection, sName);
+	if (value != NULL) {
+		float values[9];
+		if (readFloats(value, values, 9) != 9) {
 			return vDefault;
 		}
 
+		Triangle tempTriangle;
+		tempTriangle.p1 = { values[0], values[1], values[2] };
+		tempTriangle.p2 = { values[3], values[4], values[5] };
+		tempTriangle.p3 = { values[6], values[7], values[8] };
 		return tempTriangle;
 	}
 	else {
@@ -23,22 +23,36 @@ class Config {
 private:
     void* m_pVariables;
     void* m_pSections;
+    char* m_pBuffer;            // the whole file, names and values are read in place
     const SimpleString m_sFileName;
-    SimpleString m_sCurrentSection;
+    int m_nCurrentSection;
     bool m_bLoaded;
+
+    const char* Find(int nSection, const char* sName) const;
 public:
+    // Names are looked up in place, nothing is allocated per lookup
     // When the variable called "sName" doesn't exit, you will get "default" 
-    bool GetByNameAsBoolean(const SimpleString  & sName, bool bDefault) const;
-    double GetByNameAsFloat(const SimpleString & sName, double fDefault) const;
-    const SimpleString &GetByNameAsString(const SimpleString  &sName, const SimpleString  & sDefault) const;
-    long GetByNameAsInteger(const SimpleString  &sName, long lDefault) const;
-    Vector GetByNameAsVector(const SimpleString &sName, const Vector& vDefault) const;
-    Point GetByNameAsPoint(const SimpleString &sName, const Point& ptDefault) const;
-	Triangle GetByNameAsTriangle(const SimpleString &sName, const Triangle& vDefault) const;
-	Colour GetByNameAsFloatOrColour(const SimpleString& sName, double fDefaut) const;
+    bool GetByNameAsBoolean(const char* sName, bool bDefault) const;
+    double GetByNameAsFloat(const char* sName, double fDefault) const;
+    // The string points into the file's buffer, so it lasts as long as the Config does
+    const char* GetByNameAsString(const char* sName, const char* sDefault) const;
+    long GetByNameAsInteger(const char* sName, long lDefault) const;
+    Vector GetByNameAsVector(const char* sName, const Vector& vDefault) const;
+    Point GetByNameAsPoint(const char* sName, const Point& ptDefault) const;
+	Triangle GetByNameAsTriangle(const char* sName, const Triangle& vDefault) const;
+	// Same as above, from the given section rather than the current one (safe to call from several threads at once)
+	Triangle GetByNameAsTriangle(int nSection, const char* sName, const Triangle& vDefault) const;
+	Colour GetByNameAsFloatOrColour(const char* sName, double fDefaut) const;
     
     // SetSection will return -1 when the section wasn't found. 
-    int SetSection(const SimpleString &sName);
+    int SetSection(const char* sName);
+    // Number of the current section (-1 if there isn't one), for the lookups that take a section
+    int GetSection() const { return m_nCurrentSection; }
+    // Sections are numbered from 0 in the order they are in the file (there are none until SetSection has been called)
+    int GetSectionCount() const;
+    const char* GetSectionName(int nSection) const;
+    // Hash of everything in a section, so edited sections can be found (spaces and comments don't count)
+    unsigned long long GetSectionHash(int nSection) const;
     ~Config();
     Config(const SimpleString &sFileName);
 };
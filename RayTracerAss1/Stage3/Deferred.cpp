@@ -0,0 +1,488 @@
+#include "Deferred.h"
+#include "Lighting.h"
+#include "Texturing.h"
+#include "TextureCache.h"
+#include "FastMath.h"
+
+// allocate g-buffer storage big enough for one tile
+void createGBuffer(GBuffer* gbuffer, const Scene* scene, unsigned int blockSize, unsigned int samplesPerPixel)
+{
+	unsigned int capacity = blockSize * blockSize * samplesPerPixel;
+
+	gbuffer->sampleCapacity = capacity;
+	gbuffer->numMaterials = scene->numMaterials;
+	gbuffer->numSamples = 0;
+	gbuffer->numHits = 0;
+
+	gbuffer->samplePixel = new unsigned int[capacity];
+	gbuffer->sampleColour = new Colour[capacity];
+
+	gbuffer->hitSample = new unsigned int[capacity];
+	gbuffer->posX = new float[capacity];
+	gbuffer->posY = new float[capacity];
+	gbuffer->posZ = new float[capacity];
+	gbuffer->normalX = new float[capacity];
+	gbuffer->normalY = new float[capacity];
+	gbuffer->normalZ = new float[capacity];
+	gbuffer->viewX = new float[capacity];
+	gbuffer->viewY = new float[capacity];
+	gbuffer->viewZ = new float[capacity];
+	gbuffer->viewProjection = new float[capacity];
+	gbuffer->materialId = new unsigned int[capacity];
+	gbuffer->insideObject = new unsigned char[capacity];
+
+	gbuffer->materialStart = new unsigned int[scene->numMaterials + 1];
+	gbuffer->sortedHits = new unsigned int[capacity];
+	gbuffer->textureHits = new unsigned int[capacity];
+	gbuffer->textureR = new float[capacity];
+	gbuffer->textureG = new float[capacity];
+	gbuffer->textureB = new float[capacity];
+	gbuffer->specularR = new float[capacity];
+	gbuffer->specularG = new float[capacity];
+	gbuffer->specularB = new float[capacity];
+	gbuffer->outputR = new float[capacity];
+	gbuffer->outputG = new float[capacity];
+	gbuffer->outputB = new float[capacity];
+	gbuffer->lightX = new float[capacity];
+	gbuffer->lightY = new float[capacity];
+	gbuffer->lightZ = new float[capacity];
+	gbuffer->lightProjection = new float[capacity];
+	gbuffer->lightDist = new float[capacity];
+	gbuffer->blinn = new float[capacity];
+	gbuffer->visibility = new float[capacity];
+}
+
+
+// free g-buffer storage
+void destroyGBuffer(GBuffer* gbuffer)
+{
+	delete[] gbuffer->samplePixel;
+	delete[] gbuffer->sampleColour;
+
+	delete[] gbuffer->hitSample;
+	delete[] gbuffer->posX;
+	delete[] gbuffer->posY;
+	delete[] gbuffer->posZ;
+	delete[] gbuffer->normalX;
+	delete[] gbuffer->normalY;
+	delete[] gbuffer->normalZ;
+	delete[] gbuffer->viewX;
+	delete[] gbuffer->viewY;
+	delete[] gbuffer->viewZ;
+	delete[] gbuffer->viewProjection;
+	delete[] gbuffer->materialId;
+	delete[] gbuffer->insideObject;
+
+	delete[] gbuffer->materialStart;
+	delete[] gbuffer->sortedHits;
+	delete[] gbuffer->textureHits;
+	delete[] gbuffer->textureR;
+	delete[] gbuffer->textureG;
+	delete[] gbuffer->textureB;
+	delete[] gbuffer->specularR;
+	delete[] gbuffer->specularG;
+	delete[] gbuffer->specularB;
+	delete[] gbuffer->outputR;
+	delete[] gbuffer->outputG;
+	delete[] gbuffer->outputB;
+	delete[] gbuffer->lightX;
+	delete[] gbuffer->lightY;
+	delete[] gbuffer->lightZ;
+	delete[] gbuffer->lightProjection;
+	delete[] gbuffer->lightDist;
+	delete[] gbuffer->blinn;
+	delete[] gbuffer->visibility;
+}
+
+
+// rebuild the intersection details of a hit from the g-buffer
+static Intersection getHitIntersection(const Scene* scene, const GBuffer* gbuffer, unsigned int i)
+{
+	Intersection intersect;
+
+	intersect.pos.x = gbuffer->posX[i];
+	intersect.pos.y = gbuffer->posY[i];
+	intersect.pos.z = gbuffer->posZ[i];
+	intersect.normal.x = gbuffer->normalX[i];
+	intersect.normal.y = gbuffer->normalY[i];
+	intersect.normal.z = gbuffer->normalZ[i];
+	intersect.viewProjection = gbuffer->viewProjection[i];
+	intersect.insideObject = gbuffer->insideObject[i] != 0;
+	intersect.material = &scene->materialContainer[gbuffer->materialId[i]];
+
+	return intersect;
+}
+
+
+// visibility pass: cast the primary rays for every sample in the tile and record what they hit
+static void fillGBuffer(const Scene* scene, const Camera* camera, const RenderOptions* options, const Tile* tile, GBuffer* gbuffer)
+{
+	const SamplePattern* pattern = &options->samplePattern;
+	const Colour& skybox = scene->materialContainer[scene->skyboxMaterialId].diffuse;
+
+	unsigned int sample = 0, hit = 0, pixel = 0;
+	Intersection intersect;
+
+	for (int y = tile->startY - camera->centreY; y < tile->endY - camera->centreY; y++)
+	{
+		for (int x = tile->startX - camera->centreX; x < tile->endX - camera->centreX; x++, pixel++)
+		{
+			const float* offsetX, * offsetY;
+			getPixelSamples(pattern, x, y, &offsetX, &offsetY);
+
+			// loop through all sub-locations within the pixel (in the same order as the standard path)
+			for (unsigned int s = 0; s < pattern->samplesPerPixel; s++, sample++)
+			{
+				Ray viewRay = getCameraRay(camera, x + offsetX[s], y + offsetY[s]);
+
+				gbuffer->samplePixel[sample] = pixel;
+
+				// rays which miss everything only see the environment map
+				if (!objectIntersection(scene, &viewRay, &intersect))
+				{
+					gbuffer->sampleColour[sample] = skybox;
+					recordPathDepth(1);
+					continue;
+				}
+
+				calculateIntersectionResponse(scene, &viewRay, &intersect);
+
+				gbuffer->hitSample[hit] = sample;
+				gbuffer->posX[hit] = intersect.pos.x;
+				gbuffer->posY[hit] = intersect.pos.y;
+				gbuffer->posZ[hit] = intersect.pos.z;
+				gbuffer->normalX[hit] = intersect.normal.x;
+				gbuffer->normalY[hit] = intersect.normal.y;
+				gbuffer->normalZ[hit] = intersect.normal.z;
+				gbuffer->viewX[hit] = viewRay.dir.x;
+				gbuffer->viewY[hit] = viewRay.dir.y;
+				gbuffer->viewZ[hit] = viewRay.dir.z;
+				gbuffer->viewProjection[hit] = intersect.viewProjection;
+				gbuffer->materialId[hit] = (unsigned int)(intersect.material - scene->materialContainer);
+				gbuffer->insideObject[hit] = intersect.insideObject;
+				hit++;
+			}
+		}
+	}
+
+	gbuffer->numSamples = sample;
+	gbuffer->numHits = hit;
+}
+
+
+// group the hits in the tile by material (counting sort), leaving each material's hits between materialStart[m] and materialStart[m + 1]
+static void sortGBuffer(GBuffer* gbuffer)
+{
+	const unsigned int numHits = gbuffer->numHits, numMaterials = gbuffer->numMaterials;
+	unsigned int* materialStart = gbuffer->materialStart;
+
+	for (unsigned int m = 0; m <= numMaterials; ++m) materialStart[m] = 0;
+	for (unsigned int i = 0; i < numHits; ++i) materialStart[gbuffer->materialId[i] + 1]++;
+	for (unsigned int m = 0; m < numMaterials; ++m) materialStart[m + 1] += materialStart[m];
+	for (unsigned int i = 0; i < numHits; ++i) gbuffer->sortedHits[materialStart[gbuffer->materialId[i]]++] = i;
+
+	// (placing the hits moved each start on to the next material's start)
+	for (unsigned int m = numMaterials; m > 0; --m) materialStart[m] = materialStart[m - 1];
+	materialStart[0] = 0;
+}
+
+
+// look up the material colour of every hit in the tile, a batch of hits at a time
+// (the hits have to be grouped by material already, so each batch has a single texture type and set of colours)
+static void textureGBuffer(const Scene* scene, GBuffer* gbuffer)
+{
+	for (unsigned int m = 0; m < gbuffer->numMaterials; ++m)
+	{
+		const Material* material = &scene->materialContainer[m];
+		const unsigned int* hits = gbuffer->sortedHits + gbuffer->materialStart[m];
+		unsigned int end = gbuffer->materialStart[m + 1] - gbuffer->materialStart[m];
+
+		// hits found in the material's baked texture are done, the rest are listed separately and computed below
+		if (material->textureCache != NULL)
+		{
+			const unsigned int count = end;
+			end = 0;
+
+			for (unsigned int j = 0; j < count; ++j)
+			{
+				unsigned int i = hits[j];
+				Point pos = { gbuffer->posX[i], gbuffer->posY[i], gbuffer->posZ[i] };
+				int which = lookupTextureCache(material->textureCache, &pos);
+
+				if (which < 0)
+				{
+					gbuffer->textureHits[end++] = i;
+					continue;
+				}
+
+				const Colour& texture = which ? material->diffuse : material->diffuse2;
+				gbuffer->textureR[i] = texture.red;
+				gbuffer->textureG[i] = texture.green;
+				gbuffer->textureB[i] = texture.blue;
+			}
+
+			hits = gbuffer->textureHits;
+		}
+
+		for (unsigned int first = 0; first < end; first += TEXTURE_BATCH)
+		{
+			float x[TEXTURE_BATCH], y[TEXTURE_BATCH], z[TEXTURE_BATCH];
+			int which[TEXTURE_BATCH];
+
+			// gather the batch (a short final batch is padded by repeating its last hit)
+			for (int k = 0; k < TEXTURE_BATCH; ++k)
+			{
+				unsigned int i = hits[std::min(first + k, end - 1)];
+				x[k] = gbuffer->posX[i];
+				y[k] = gbuffer->posY[i];
+				z[k] = gbuffer->posZ[i];
+			}
+
+			switch (material->type)
+			{
+			case Material::CHECKERBOARD:
+				applyCheckerboardBatch(material, x, y, z, which);
+				break;
+			case Material::CIRCLES:
+				applyCirclesBatch(material, x, y, z, which);
+				break;
+			case Material::WOOD:
+				applyWoodBatch(material, x, y, z, which);
+				break;
+			default:
+				for (int k = 0; k < TEXTURE_BATCH; ++k) which[k] = 1;
+				break;
+			}
+
+			// scatter the colours back to the hits
+			for (unsigned int k = 0; k < TEXTURE_BATCH && first + k < end; ++k)
+			{
+				unsigned int i = hits[first + k];
+				const Colour& texture = which[k] ? material->diffuse : material->diffuse2;
+
+				gbuffer->textureR[i] = texture.red;
+				gbuffer->textureG[i] = texture.green;
+				gbuffer->textureB[i] = texture.blue;
+			}
+		}
+	}
+}
+
+
+// raise every hit's specular coefficient to its material's power, a material at a time (so each run uses a single evaluator)
+static void applySpecularPowers(const Scene* scene, GBuffer* gbuffer)
+{
+	for (unsigned int m = 0; m < gbuffer->numMaterials; ++m)
+	{
+		const Material* material = &scene->materialContainer[m];
+		const unsigned int start = gbuffer->materialStart[m], end = gbuffer->materialStart[m + 1];
+		float* blinn = gbuffer->blinn;
+
+		switch (material->specularType)
+		{
+		case Material::SPECULAR_INTEGER:
+			for (unsigned int j = start; j < end; ++j) blinn[gbuffer->sortedHits[j]] = powi(blinn[gbuffer->sortedHits[j]], material->integerPower);
+			break;
+		case Material::SPECULAR_GENERAL:
+			for (unsigned int j = start; j < end; ++j) blinn[gbuffer->sortedHits[j]] = fastPow(blinn[gbuffer->sortedHits[j]], material->power);
+			break;
+		default:
+			for (unsigned int j = start; j < end; ++j) blinn[gbuffer->sortedHits[j]] = 0.0f;
+			break;
+		}
+	}
+}
+
+
+// lighting pass: apply the diffuse and specular lighting of every light to all the hits in the tile
+// works light by light over arrays of hits, so the geometry and accumulation loops run across many pixels at once
+static void shadeGBuffer(const Scene* scene, const RenderOptions* options, GBuffer* gbuffer)
+{
+	const unsigned int numHits = gbuffer->numHits;
+
+	sortGBuffer(gbuffer);
+
+	// material colours don't depend on the light, so only look them up once per hit
+	if (options->scalarTextures)
+	{
+		for (unsigned int i = 0; i < numHits; ++i)
+		{
+			Intersection intersect = getHitIntersection(scene, gbuffer, i);
+			Colour texture = applyTexture(&intersect);
+
+			gbuffer->textureR[i] = texture.red;
+			gbuffer->textureG[i] = texture.green;
+			gbuffer->textureB[i] = texture.blue;
+		}
+	}
+	else
+	{
+		textureGBuffer(scene, gbuffer);
+	}
+
+	// (specular colours too, which are black for materials without a specular, so the lighting loops needn't check)
+	for (unsigned int i = 0; i < numHits; ++i)
+	{
+		const Material* material = &scene->materialContainer[gbuffer->materialId[i]];
+		const bool specular = material->specularType != Material::SPECULAR_NONE;
+
+		gbuffer->specularR[i] = specular ? material->specular.red : 0.0f;
+		gbuffer->specularG[i] = specular ? material->specular.green : 0.0f;
+		gbuffer->specularB[i] = specular ? material->specular.blue : 0.0f;
+	}
+
+	for (unsigned int i = 0; i < numHits; ++i)
+	{
+		gbuffer->outputR[i] = 0.0f;
+		gbuffer->outputG[i] = 0.0f;
+		gbuffer->outputB[i] = 0.0f;
+	}
+
+	// (local copies of the g-buffer's arrays, so the compiler doesn't reload them after every store)
+	const float* posX = gbuffer->posX, * posY = gbuffer->posY, * posZ = gbuffer->posZ;
+	const float* normalX = gbuffer->normalX, * normalY = gbuffer->normalY, * normalZ = gbuffer->normalZ;
+	const float* viewX = gbuffer->viewX, * viewY = gbuffer->viewY, * viewZ = gbuffer->viewZ;
+	const float* viewProjection = gbuffer->viewProjection;
+	const unsigned char* insideObject = gbuffer->insideObject;
+	const float* textureR = gbuffer->textureR, * textureG = gbuffer->textureG, * textureB = gbuffer->textureB;
+	const float* specularR = gbuffer->specularR, * specularG = gbuffer->specularG, * specularB = gbuffer->specularB;
+	float* outputR = gbuffer->outputR, * outputG = gbuffer->outputG, * outputB = gbuffer->outputB;
+	float* lightX = gbuffer->lightX, * lightY = gbuffer->lightY, * lightZ = gbuffer->lightZ;
+	float* lightProjection = gbuffer->lightProjection;
+	float* lightDist = gbuffer->lightDist;
+	float* visibility = gbuffer->visibility;
+	float* blinn = gbuffer->blinn;
+
+	for (unsigned int j = 0; j < scene->numLights; ++j)
+	{
+		// (copied, so the compiler knows the stores into the g-buffer can't change them)
+		const Point lightPos = scene->lightContainer[j].pos;
+		const Colour intensity = scene->lightContainer[j].intensity;
+
+		// light direction, distance, and projection for every hit (the same calculations as applyLighting)
+		VECTORISE_LOOP
+		for (unsigned int i = 0; i < numHits; ++i)
+		{
+			float dx = lightPos.x - posX[i];
+			float dy = lightPos.y - posY[i];
+			float dz = lightPos.z - posZ[i];
+
+			float angleBetweenLightAndNormal = dx * normalX[i] + dy * normalY[i] + dz * normalZ[i];
+			float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+			float invLightDist = 1.0f / distance;
+
+			lightDist[i] = distance;
+			lightProjection[i] = invLightDist * angleBetweenLightAndNormal;
+			lightX[i] = dx * invLightDist;
+			lightY[i] = dy * invLightDist;
+			lightZ[i] = dz * invLightDist;
+
+			// skip this light if it's behind the object, or if we are inside an object
+			visibility[i] = (angleBetweenLightAndNormal > 0.0f && !insideObject[i]) ? 1.0f : 0.0f;
+		}
+
+		// shadow rays (or shadow map lookups) are still done one at a time
+		for (unsigned int i = 0; i < numHits; ++i)
+		{
+			if (visibility[i] == 0.0f) continue;
+
+			Ray lightRay = { { posX[i], posY[i], posZ[i] }, { lightX[i], lightY[i], lightZ[i] } };
+			Vector normal = { normalX[i], normalY[i], normalZ[i] };
+
+			visibility[i] = getLightVisibility(scene, j, &lightRay, lightDist[i], &normal);
+		}
+
+		// add the diffuse lighting from this light, and find its specular coefficient (hidden hits add nothing, rather than being skipped)
+		VECTORISE_LOOP
+		for (unsigned int i = 0; i < numHits; ++i)
+		{
+			float visible = visibility[i];
+			float lambert = lightX[i] * normalX[i] + lightY[i] * normalY[i] + lightZ[i] * normalZ[i];
+
+			outputR[i] += visible * (lambert * intensity.red * textureR[i]);
+			outputG[i] += visible * (lambert * intensity.green * textureG[i]);
+			outputB[i] += visible * (lambert * intensity.blue * textureB[i]);
+
+			// Blinn (see applySpecular)
+			float bx = lightX[i] - viewX[i];
+			float by = lightY[i] - viewY[i];
+			float bz = lightZ[i] - viewZ[i];
+			float coefficient = invsqrtf(bx * bx + by * by + bz * bz) * std::max(lightProjection[i] - viewProjection[i], 0.0f);
+			blinn[i] = visible > 0.0f ? coefficient : 0.0f;
+		}
+
+		applySpecularPowers(scene, gbuffer);
+
+		// add the specular lighting from this light
+		VECTORISE_LOOP
+		for (unsigned int i = 0; i < numHits; ++i)
+		{
+			outputR[i] += visibility[i] * (blinn[i] * specularR[i] * intensity.red);
+			outputG[i] += visibility[i] * (blinn[i] * specularG[i] * intensity.green);
+			outputB[i] += visibility[i] * (blinn[i] * specularB[i] * intensity.blue);
+		}
+	}
+}
+
+
+// render a single tile with a visibility pass filling the g-buffer followed by a lighting pass over all of its hits
+// reflection and refraction rays leaving the primary hits are traced the normal way
+void renderTileDeferred(const Scene* scene, const Camera* camera, const RenderOptions* options, const Tile* tile, int threadId, GBuffer* gbuffer)
+{
+	const float sampleRatio = 1.0f / options->samplePattern.samplesPerPixel;
+
+	fillGBuffer(scene, camera, options, tile, gbuffer);
+	shadeGBuffer(scene, options, gbuffer);
+
+	// continue each hit's path with the reflected or refracted ray
+	for (unsigned int i = 0; i < gbuffer->numHits; ++i)
+	{
+		Intersection intersect = getHitIntersection(scene, gbuffer, i);
+		Colour lighting(gbuffer->outputR[i], gbuffer->outputG[i], gbuffer->outputB[i]);
+
+		Ray viewRay = { camera->position, { gbuffer->viewX[i], gbuffer->viewY[i], gbuffer->viewZ[i] } };
+		RayPath path;
+		startPath(&path, &viewRay);
+
+		if (!intersect.insideObject) path.output += path.coef * lighting;
+
+		if (bouncePath(&path, &intersect))
+		{
+			path.level++;
+			finishPath(scene, options, &path);
+		}
+		else
+		{
+			recordPathDepth(1);
+		}
+
+		gbuffer->sampleColour[gbuffer->hitSample[i]] = path.output;
+	}
+
+	// sum each pixel's samples (in the order they were taken) and write them out
+	const int tileWidth = tile->endX - tile->startX;
+	unsigned int sample = 0;
+
+	for (int py = tile->startY; py < tile->endY; py++)
+	{
+		unsigned int* out = buffer + getImageIndex(options, tile->startX, py);
+
+		for (int px = 0; px < tileWidth; px++)
+		{
+			unsigned int pixel = (py - tile->startY) * tileWidth + px;
+			Colour output(0.0f, 0.0f, 0.0f);
+
+			for (; sample < gbuffer->numSamples && gbuffer->samplePixel[sample] == pixel; sample++)
+			{
+				output += sampleRatio * gbuffer->sampleColour[sample];
+			}
+
+			//color rise processing
+			if (options->colourise) {
+				output.colourise(threadId % 7);
+			}
+
+			*out++ = output.convertToPixel(scene->exposure);
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef __DEFERRED_H
+#define __DEFERRED_H
+
+#include "Render.h"
+
+// per tile record of the primary ray samples and their hits, used to shade a whole tile at once
+// hit data is stored as separate arrays (rather than an array of structs) so the lighting loops vectorise
+typedef struct GBuffer
+{
+	unsigned int sampleCapacity;	// maximum number of samples (and so hits) in a tile
+	unsigned int numMaterials;		// number of materials in the scene
+	unsigned int numSamples;		// samples taken in the current tile
+	unsigned int numHits;			// samples which hit an object in the current tile
+
+	// per sample data
+	unsigned int* samplePixel;		// pixel (within the tile) the sample belongs to
+	Colour* sampleColour;			// final colour of the sample
+
+	// per hit data
+	unsigned int* hitSample;		// sample the hit belongs to
+	float* posX, * posY, * posZ;	// point of intersection
+	float* normalX, * normalY, * normalZ;	// normal at point of intersection
+	float* viewX, * viewY, * viewZ;	// direction of the primary ray
+	float* viewProjection;			// view projection
+	unsigned int* materialId;		// material of the object hit
+	unsigned char* insideObject;	// whether or not inside an object
+
+	// lighting pass working space (per hit)
+	unsigned int* materialStart;					// start of each material's hits in sortedHits (per material, plus one)
+	unsigned int* sortedHits;						// hits grouped by material, for batched texturing and specular powers
+	unsigned int* textureHits;						// hits of the current material still to be textured
+	float* textureR, * textureG, * textureB;		// material colour before lighting
+	float* specularR, * specularG, * specularB;		// material specular colour (black if it has no specular)
+	float* outputR, * outputG, * outputB;			// accumulated lighting
+	float* lightX, * lightY, * lightZ;				// normalised direction to the current light
+	float* lightProjection;							// projection of the light direction onto the normal
+	float* lightDist;								// distance to the current light
+	float* blinn;									// specular coefficient for the current light
+	float* visibility;								// fraction of the current light reaching the hit
+} GBuffer;
+
+// allocate g-buffer storage big enough for one tile
+void createGBuffer(GBuffer* gbuffer, const Scene* scene, unsigned int blockSize, unsigned int samplesPerPixel);
+
+// free g-buffer storage
+void destroyGBuffer(GBuffer* gbuffer);
+
+// render a single tile with a visibility pass filling the g-buffer followed by a lighting pass over all of its hits
+// reflection and refraction rays leaving the primary hits are traced the normal way
+void renderTileDeferred(const Scene* scene, const Camera* camera, const RenderOptions* options, const Tile* tile, int threadId, GBuffer* gbuffer);
+
+#endif // __DEFERRED_H
@@ -0,0 +1,126 @@
+#include <string.h>
+
+#include "Filter.h"
+
+// distance (in pixels, along each axis) from a pixel's centre at which the filters fall to zero
+// samples this far out come from the neighbouring pixels, so the apron only needs to be one pixel wide
+const float FILTER_RADIUS = 1.5f;
+
+// falloff of the Gaussian filter (a standard deviation of half a pixel)
+const float GAUSSIAN_ALPHA = 2.0f;
+
+
+// allocate filter storage big enough for one tile and the one pixel apron around it
+void createFilterBuffer(FilterBuffer* filter, unsigned int blockSize, unsigned int samplesPerPixel)
+{
+	filter->pixelCapacity = (blockSize + 2) * (blockSize + 2);
+	filter->samplesPerPixel = samplesPerPixel;
+	filter->sampleColour = new Colour[filter->pixelCapacity * samplesPerPixel];
+}
+
+
+// free filter storage
+void destroyFilterBuffer(FilterBuffer* filter)
+{
+	delete[] filter->sampleColour;
+}
+
+
+// filter type for a name given on the command line (returns -1 if the name isn't known)
+int getFilterType(const char* name)
+{
+	if (strcmp(name, "box") == 0) return RenderOptions::BOX;
+	if (strcmp(name, "tent") == 0) return RenderOptions::TENT;
+	if (strcmp(name, "gaussian") == 0) return RenderOptions::GAUSSIAN;
+	return -1;
+}
+
+
+// weight of a sample the given distance (along one axis) from the pixel's centre
+static float getFilterWeight(int type, float distance)
+{
+	distance = fabsf(distance);
+	if (distance >= FILTER_RADIUS) return 0.0f;
+
+	if (type == RenderOptions::TENT) return 1.0f - distance / FILTER_RADIUS;
+
+	// Gaussian, shifted down so it reaches zero at the radius
+	return expf(-GAUSSIAN_ALPHA * distance * distance) - expf(-GAUSSIAN_ALPHA * FILTER_RADIUS * FILTER_RADIUS);
+}
+
+
+// render a single tile, tracing the samples of its pixels and of a one pixel apron around it (shared with the neighbouring tiles),
+// then reconstructing each pixel from the samples of its own and its neighbours' pixels with a tent or Gaussian filter
+void renderTileFiltered(const Scene* scene, const Camera* camera, const RenderOptions* options, const Tile* tile, int threadId, FilterBuffer* filter)
+{
+	const SamplePattern* pattern = &options->samplePattern;
+	const unsigned int samplesPerPixel = pattern->samplesPerPixel;
+
+	// the apron (clipped to the image) is traced along with the tile
+	const int apronStartX = std::max(tile->startX - 1, 0), apronEndX = std::min(tile->endX + 1, options->width);
+	const int apronStartY = std::max(tile->startY - 1, 0), apronEndY = std::min(tile->endY + 1, options->height);
+	const int apronWidth = apronEndX - apronStartX;
+
+	// centre of the samples in a pixel (the regular grid starts at the pixel's corner)
+	const float centre = pattern->type == SamplePattern::REGULAR ? (pattern->aaLevel - 1) / (2.0f * pattern->aaLevel) : 0.5f;
+
+	// trace every sample of the tile and its apron
+	for (int py = apronStartY; py < apronEndY; py++)
+	{
+		int y = py - camera->centreY;
+
+		for (int px = apronStartX; px < apronEndX; px++)
+		{
+			int x = px - camera->centreX;
+			Colour* sampleColour = filter->sampleColour + ((py - apronStartY) * apronWidth + (px - apronStartX)) * samplesPerPixel;
+
+			const float* offsetX, * offsetY;
+			getPixelSamples(pattern, x, y, &offsetX, &offsetY);
+
+			for (unsigned int s = 0; s < samplesPerPixel; s++)
+			{
+				sampleColour[s] = traceRay(scene, options, getCameraRay(camera, x + offsetX[s], y + offsetY[s]));
+			}
+		}
+	}
+
+	// reconstruct each pixel from the samples of the pixels around it
+	for (int py = tile->startY; py < tile->endY; py++)
+	{
+		unsigned int* out = buffer + getImageIndex(options, tile->startX, py);
+
+		for (int px = tile->startX; px < tile->endX; px++)
+		{
+			Colour output(0.0f, 0.0f, 0.0f);
+			float totalWeight = 0.0f;
+
+			for (int ny = std::max(py - 1, apronStartY); ny <= std::min(py + 1, apronEndY - 1); ny++)
+			{
+				for (int nx = std::max(px - 1, apronStartX); nx <= std::min(px + 1, apronEndX - 1); nx++)
+				{
+					const Colour* sampleColour = filter->sampleColour + ((ny - apronStartY) * apronWidth + (nx - apronStartX)) * samplesPerPixel;
+
+					const float* offsetX, * offsetY;
+					getPixelSamples(pattern, nx - camera->centreX, ny - camera->centreY, &offsetX, &offsetY);
+
+					for (unsigned int s = 0; s < samplesPerPixel; s++)
+					{
+						float weight = getFilterWeight(options->filter, nx - px + offsetX[s] - centre) * getFilterWeight(options->filter, ny - py + offsetY[s] - centre);
+						output += weight * sampleColour[s];
+						totalWeight += weight;
+					}
+				}
+			}
+
+			output = (1.0f / totalWeight) * output;
+
+			//color rise processing
+			if (options->colourise) {
+				output.colourise(threadId % 7);
+			}
+
+			// store saturated final colour value in image buffer
+			*out++ = output.convertToPixel(scene->exposure);
+		}
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef __FILTER_H
+#define __FILTER_H
+
+#include "Render.h"
+
+// per tile working space for the wide reconstruction filters
+typedef struct FilterBuffer
+{
+	unsigned int pixelCapacity;		// maximum number of pixels in a tile plus its apron
+	unsigned int samplesPerPixel;	// samples taken in each pixel
+	Colour* sampleColour;			// colour of each sample, pixel by pixel across the tile and its apron
+} FilterBuffer;
+
+// allocate filter storage big enough for one tile and the one pixel apron around it
+void createFilterBuffer(FilterBuffer* filter, unsigned int blockSize, unsigned int samplesPerPixel);
+
+// free filter storage
+void destroyFilterBuffer(FilterBuffer* filter);
+
+// filter type for a name given on the command line (returns -1 if the name isn't known)
+int getFilterType(const char* name);
+
+// render a single tile, tracing the samples of its pixels and of a one pixel apron around it (shared with the neighbouring tiles),
+// then reconstructing each pixel from the samples of its own and its neighbours' pixels with a tent or Gaussian filter
+void renderTileFiltered(const Scene* scene, const Camera* camera, const RenderOptions* options, const Tile* tile, int threadId, FilterBuffer* filter);
+
+#endif // __FILTER_H
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <fstream>
+
+#include "ImageCompare.h"
+
+// little endian integers, as stored in BMP headers
+static unsigned int readInt32(std::ifstream& f)
+{
+	char value1, value2, value3, value4;
+	f.get(value1);
+	f.get(value2);
+	f.get(value3);
+	f.get(value4);
+
+	return (((unsigned char)value4) << 24) | (((unsigned char)value3) << 16) | (((unsigned char)value2) << 8) | (unsigned char)value1;
+}
+
+static unsigned int readInt16(std::ifstream& f)
+{
+	char value1, value2;
+	f.get(value1);
+	f.get(value2);
+
+	return (((unsigned char)value2) << 8) | ((unsigned char)value1);
+}
+
+
+// read a 24bpp BMP (as written by write_bmp) into a buffer of at most maxPixels pixels
+bool read_bmp(const char* name, unsigned int* screen, int* width, int* height, int maxPixels)
+{
+	std::ifstream imageFile(name, std::ios_base::binary);
+	if (!imageFile) 
+	{
+		fprintf(stderr, "Failed to open %s.\n", name);
+		return false;
+	}
+
+	char b, m;
+	imageFile.get(b);
+	imageFile.get(m);
+	if (b != 'B' || m != 'M') 
+	{
+		fprintf(stderr, "File %s not a BMP.\n", name);
+		return false;
+	}
+
+	readInt32(imageFile);		// file size
+	readInt32(imageFile);		// reserved
+	int offset = readInt32(imageFile);
+	readInt32(imageFile);		// header size
+
+	*width = readInt32(imageFile);
+	*height = readInt32(imageFile);
+	readInt16(imageFile);		// planes
+
+	if (readInt16(imageFile) != 24) 
+	{
+		fprintf(stderr, "BMP %s not 24bpp.\n", name);
+		return false;
+	}
+
+	if (*width * *height > maxPixels)
+	{
+		fprintf(stderr, "BMP %s too big.\n", name);
+		return false;
+	}
+
+	imageFile.seekg(offset);
+
+	// rows are not padded (matching write_bmp)
+	for (int y = 0; y < *height; ++y)
+	{
+		for (int x = 0; x < *width; ++x)
+		{
+			char r, g, b;
+			imageFile.get(b).get(g).get(r);
+			screen[x + y * *width] = ((b & 0xFF) << 16) | ((g & 0xFF) << 8) | (r & 0xFF);
+		}
+	}
+
+	return (bool)imageFile;
+}
+
+
+// compare an image against a reference BMP and print the error (RMSE and PSNR over all channels)
+bool compare_bmp(const char* name, unsigned int* screen, int width, int height, int stride)
+{
+	int refWidth, refHeight;
+	unsigned int* reference = new unsigned int[width * height];
+
+	if (!read_bmp(name, reference, &refWidth, &refHeight, width * height) || refWidth != width || refHeight != height)
+	{
+		fprintf(stderr, "Reference image %s missing or a different size.\n", name);
+		delete[] reference;
+		return false;
+	}
+
+	double squaredError = 0.0;
+	int maxError = 0, differentPixels = 0;
+
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			unsigned int a = screen[y * stride + x], b = reference[y * width + x];
+
+			differentPixels += (a != b);
+
+			for (int shift = 0; shift < 24; shift += 8)
+			{
+				int error = abs((int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF));
+				squaredError += error * error;
+				maxError = error > maxError ? error : maxError;
+			}
+		}
+	}
+
+	double rmse = sqrt(squaredError / (3.0 * width * height));
+
+	if (rmse > 0.0)
+		printf("Image error against %s: RMSE %.3f, PSNR %.2fdB, max %d, %.2f%% of pixels differ\n", name, rmse, 20.0 * log10(255.0 / rmse), maxError, 100.0 * differentPixels / (width * height));
+	else
+		printf("Image error against %s: identical\n", name);
+
+	delete[] reference;
+	return true;
+}
@@ -0,0 +1,10 @@
+#ifndef __IMAGE_COMPARE_H
+#define __IMAGE_COMPARE_H
+
+// read a 24bpp BMP (as written by write_bmp) into a buffer of at most maxPixels pixels
+bool read_bmp(const char* name, unsigned int* screen, int* width, int* height, int maxPixels);
+
+// compare an image against a reference BMP and print the error (RMSE and PSNR over all channels)
+bool compare_bmp(const char* name, unsigned int* screen, int width, int height, int stride);
+
+#endif // __IMAGE_COMPARE_H
@@ -2,7 +2,14 @@
 	Ray tracing tutorial of http://www.codermind.com/articles/Raytracer-in-C++-Introduction-What-is-ray-tracing.html
 	It is free to use for educational purpose and cannot be redistributed outside of the tutorial pages. */
 
+#include <cmath>
+
 #include "Intersection.h"
+#include "Bvh.h"
+#include "Mesh.h"
+
+// rays intersected with the hierarchy together, as a packet, by objectIntersectionBatch
+const unsigned int BVH_PACKET_RAYS = 64;
 
 // test to see if collision between ray and a plane happens before time t (equivalent to distance)
 // updates closest collision time (/distance) if collision occurs
@@ -92,6 +99,43 @@ bool isTriangleIntersected(const Triangle* tri, const Ray* r, float* t)
 }
 
 
+// test to see if collision between ray and any of a mesh's triangles happens before time t (equivalent to distance)
+// updates closest collision time (/distance) and the triangle hit if collision occurs, stopping at the first collision found if firstHit is set
+bool isMeshIntersected(const Mesh* mesh, const Ray* r, float* t, bool firstHit, unsigned int* triangle)
+{
+	bool hit = false;
+
+	// the test only needs the corners, so they're gathered into a triangle of their own
+	Triangle tri;
+
+	for (unsigned int i = 0; i < mesh->numTriangles; ++i)
+	{
+		const unsigned int* index = &mesh->indices[i * 3];
+		if (mesh->quantized == NULL)
+		{
+			tri.p1 = mesh->vertices[index[0]];
+			tri.p2 = mesh->vertices[index[1]];
+			tri.p3 = mesh->vertices[index[2]];
+		}
+		else
+		{
+			tri.p1 = getMeshVertex(mesh, index[0]);
+			tri.p2 = getMeshVertex(mesh, index[1]);
+			tri.p3 = getMeshVertex(mesh, index[2]);
+		}
+
+		if (isTriangleIntersected(&tri, r, t))
+		{
+			*triangle = i;
+			hit = true;
+			if (firstHit) break;
+		}
+	}
+
+	return hit;
+}
+
+
 // calculate collision normal, viewProjection, object's material, and test to see if inside collision object
 void calculateIntersectionResponse(const Scene* scene, const Ray* viewRay, Intersection* intersect)
 {
@@ -104,6 +148,15 @@ void calculateIntersectionResponse(const Scene* scene, const Ray* viewRay, Inter
 	case Intersection::TRIANGLE:
 		intersect->normal = intersect->triangle->normal;
 		intersect->material = &scene->materialContainer[intersect->triangle->materialId];
+		break;
+	case Intersection::MESH:
+	{
+		// meshes don't store normals, so it's worked out from the triangle's corners (the same way as for triangles)
+		const unsigned int* index = &intersect->mesh->indices[intersect->meshTriangle * 3];
+		const Point p1 = getMeshVertex(intersect->mesh, index[0]);
+		intersect->normal = normalise(cross(getMeshVertex(intersect->mesh, index[1]) - p1, getMeshVertex(intersect->mesh, index[2]) - p1));
+		intersect->material = &scene->materialContainer[intersect->mesh->materialId];
+	}
 	}
 
 	// calculate view projection
@@ -120,6 +173,174 @@ void calculateIntersectionResponse(const Scene* scene, const Ray* viewRay, Inter
 }
 
 
+// 1 / each component of a ray's direction (for the ray / box tests), with zeros nudged so a test never works out 0 * infinity
+static inline Vector getInverseDirection(const Vector& dir)
+{
+	return Vector{ 1.0f / (dir.x != 0.0f ? dir.x : 1e-30f), 1.0f / (dir.y != 0.0f ? dir.y : 1e-30f), 1.0f / (dir.z != 0.0f ? dir.z : 1e-30f) };
+}
+
+
+// distance along a ray to where it enters a node's box, or infinity if it misses the box (or only reaches it after t)
+static inline float getBoxEntry(const BvhNode* node, const Point& start, const Vector& invDir, float t)
+{
+	float x0 = (node->boundsMin.x - start.x) * invDir.x, x1 = (node->boundsMax.x - start.x) * invDir.x;
+	float y0 = (node->boundsMin.y - start.y) * invDir.y, y1 = (node->boundsMax.y - start.y) * invDir.y;
+	float z0 = (node->boundsMin.z - start.z) * invDir.z, z1 = (node->boundsMax.z - start.z) * invDir.z;
+
+	float entry = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::min(z0, z1));
+	float exit = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::max(z0, z1));
+
+	// (boxes entered at exactly t are still visited, as they can hold an object tied with the closest so far)
+	return (entry <= exit && exit >= 0.0f && entry <= t) ? entry : INFINITY;
+}
+
+
+// test to see if collision between ray and an object (given by its object number, and its mesh if it's one of a mesh's triangles) happens before time t
+// updates closest collision time (/distance) if collision occurs
+static inline bool isObjectIntersected(const Scene* scene, unsigned int object, unsigned int meshIndex, const Ray* r, float* t)
+{
+	if (object < scene->numSpheres) return isSphereIntersected(&scene->sphereContainer[object], r, t);
+	object -= scene->numSpheres;
+
+	if (object < scene->numTriangles) return isTriangleIntersected(&scene->triangleContainer[object], r, t);
+	object -= scene->numTriangles;
+
+	const Mesh* mesh = &scene->meshContainer[meshIndex];
+	object -= mesh->firstTriangle;
+
+	const unsigned int* index = &mesh->indices[object * 3];
+	Triangle tri;
+	tri.p1 = getMeshVertex(mesh, index[0]);
+	tri.p2 = getMeshVertex(mesh, index[1]);
+	tri.p3 = getMeshVertex(mesh, index[2]);
+
+	return isTriangleIntersected(&tri, r, t);
+}
+
+
+// closest collision between ray and the objects in the scene's hierarchy (nearer boxes first, skipping boxes beyond the closest collision so far)
+// an object the same distance away as the closest so far replaces it if it has a lower object number, so the result doesn't depend on the order of the objects
+static bool isBvhIntersected(const Scene* scene, const Ray* r, float* t, int* object)
+{
+	const BvhNode* nodes = scene->bvh->nodes;
+	const unsigned int* objects = scene->bvh->objects;
+	const unsigned int* objectMeshes = scene->bvh->objectMeshes;
+	const Vector invDir = getInverseDirection(r->dir);
+
+	struct { unsigned int node; float entry; } stack[BVH_MAX_DEPTH];
+	unsigned int depth = 0;
+
+	if (getBoxEntry(&nodes[0], r->start, invDir, *t) == INFINITY) return false;
+
+	// objects are tested against a limit just past t, so ties are found
+	float limit = nextafterf(*t, INFINITY);
+	unsigned int node = 0;
+	bool hit = false;
+
+	for (;;)
+	{
+		const BvhNode* current = &nodes[node];
+
+		if (current->count == 0)
+		{
+			unsigned int first = current->first;
+			float entry0 = getBoxEntry(&nodes[first], r->start, invDir, *t);
+			float entry1 = getBoxEntry(&nodes[first + 1], r->start, invDir, *t);
+
+			// carry on into the nearer child, leaving the other for later
+			if (entry1 < entry0)
+			{
+				std::swap(entry0, entry1);
+				first++;
+				if (entry1 != INFINITY) stack[depth++] = { first - 1, entry1 };
+			}
+			else if (entry1 != INFINITY)
+			{
+				stack[depth++] = { first + 1, entry1 };
+			}
+
+			if (entry0 != INFINITY)
+			{
+				node = first;
+				continue;
+			}
+		}
+		else
+		{
+			for (unsigned int i = 0; i < current->count; ++i)
+			{
+				unsigned int candidate = objects[current->first + i];
+				float candidateT = limit;
+
+				if (isObjectIntersected(scene, candidate, objectMeshes[current->first + i], r, &candidateT) && (candidateT < *t || (int)candidate < *object))
+				{
+					*t = candidateT;
+					*object = (int)candidate;
+					limit = nextafterf(*t, INFINITY);
+					hit = true;
+				}
+			}
+		}
+
+		// next waiting node that's still no further away than the closest collision
+		do
+		{
+			if (depth == 0) return hit;
+			--depth;
+		} while (stack[depth].entry > *t);
+
+		node = stack[depth].node;
+	}
+}
+
+
+// test to see if collision between ray and any object in the scene's hierarchy happens before time t
+bool isBvhOccluded(const Scene* scene, const Ray* r, float t)
+{
+	const BvhNode* nodes = scene->bvh->nodes;
+	const unsigned int* objects = scene->bvh->objects;
+	const unsigned int* objectMeshes = scene->bvh->objectMeshes;
+	const Vector invDir = getInverseDirection(r->dir);
+
+	unsigned int stack[BVH_MAX_DEPTH];
+	unsigned int depth = 0;
+	unsigned int node = 0;
+
+	if (getBoxEntry(&nodes[0], r->start, invDir, t) == INFINITY) return false;
+
+	// any collision will do, so the children are visited in order
+	for (;;)
+	{
+		const BvhNode* current = &nodes[node];
+
+		if (current->count == 0)
+		{
+			unsigned int first = current->first;
+			bool hit0 = getBoxEntry(&nodes[first], r->start, invDir, t) != INFINITY;
+			bool hit1 = getBoxEntry(&nodes[first + 1], r->start, invDir, t) != INFINITY;
+
+			if (hit0 && hit1) stack[depth++] = first + 1;
+			if (hit0 || hit1)
+			{
+				node = hit0 ? first : first + 1;
+				continue;
+			}
+		}
+		else
+		{
+			for (unsigned int i = 0; i < current->count; ++i)
+			{
+				float objectT = t;
+				if (isObjectIntersected(scene, objects[current->first + i], objectMeshes[current->first + i], r, &objectT)) return true;
+			}
+		}
+
+		if (depth == 0) return false;
+		node = stack[--depth];
+	}
+}
+
+
 // test to see if collision between ray and any object in the scene
 // updates intersection structure if collision occurs
 bool objectIntersection(const Scene* scene, const Ray* viewRay, Intersection* intersect)
@@ -130,6 +351,17 @@ bool objectIntersection(const Scene* scene, const Ray* viewRay, Intersection* in
 	// no intersection found by default
 	intersect->objectType = Intersection::NONE;
 
+	// only the objects in the boxes the ray passes through are tested when the scene has a hierarchy
+	if (scene->bvh != NULL)
+	{
+		int object = -1;
+		if (!isBvhIntersected(scene, viewRay, &t, &object)) return false;
+
+		setIntersectionObject(scene, object, intersect);
+		intersect->pos = viewRay->start + viewRay->dir * t;
+		return true;
+	}
+
 	// search for sphere collisions, storing closest one found
     for (unsigned int i = 0; i < scene->numSpheres; ++i)
     {
@@ -150,6 +382,16 @@ bool objectIntersection(const Scene* scene, const Ray* viewRay, Intersection* in
 		}
 	}
 
+	// search for mesh collisions, storing closest one found
+	for (unsigned int m = 0; m < scene->numMeshes; ++m)
+	{
+		if (isMeshIntersected(&scene->meshContainer[m], viewRay, &t, false, &intersect->meshTriangle))
+		{
+			intersect->objectType = Intersection::MESH;
+			intersect->mesh = &scene->meshContainer[m];
+		}
+	}
+
 	// nothing detected, return false
 	if (intersect->objectType == Intersection::NONE)
 	{
@@ -161,3 +403,231 @@ bool objectIntersection(const Scene* scene, const Ray* viewRay, Intersection* in
 
 	return true;
 }
+
+
+// closest intersection of each of a batch of rays with a single triangle (the batched form of isTriangleIntersected)
+static inline void triangleIntersectionBatch(const Point& p1, const Point& p2, const Point& p3, int object, unsigned int count,
+	const float* startX, const float* startY, const float* startZ, const float* dirX, const float* dirY, const float* dirZ, float* t, int* hitObject)
+{
+	const Vector e1 = p2 - p1;
+	const Vector e2 = p3 - p1;
+
+	for (unsigned int r = 0; r < count; ++r)
+	{
+		// h = cross(dir, e2)
+		float hx = dirY[r] * e2.z - dirZ[r] * e2.y;
+		float hy = dirZ[r] * e2.x - dirX[r] * e2.z;
+		float hz = dirX[r] * e2.y - dirY[r] * e2.x;
+
+		float det = e1.x * hx + e1.y * hy + e1.z * hz;
+		float invDet = 1.0f / det;
+
+		float sx = startX[r] - p1.x, sy = startY[r] - p1.y, sz = startZ[r] - p1.z;
+		float u = invDet * (sx * hx + sy * hy + sz * hz);
+
+		// q = cross(s, e1)
+		float qx = sy * e1.z - sz * e1.y;
+		float qy = sz * e1.x - sx * e1.z;
+		float qz = sx * e1.y - sy * e1.x;
+
+		float v = invDet * (qx * dirX[r] + qy * dirY[r] + qz * dirZ[r]);
+		float t0 = invDet * (e2.x * qx + e2.y * qy + e2.z * qz);
+
+		// (ties go to the lower object number, as they would testing the objects in order)
+		bool hit = !(det > -EPSILON && det < EPSILON) && !(u < 0.0f || u > 1.0f) && !(v < 0.0f || u + v > 1.0f) && t0 > EPSILON
+			&& (t0 < t[r] || (t0 == t[r] && object < hitObject[r]));
+
+		t[r] = hit ? t0 : t[r];
+		hitObject[r] = hit ? object : hitObject[r];
+	}
+}
+
+
+// closest intersection of each of a batch of rays with a single sphere (the batched form of isSphereIntersected)
+static inline void sphereIntersectionBatch(const Sphere* s, int object, unsigned int count,
+	const float* startX, const float* startY, const float* startZ, const float* dirX, const float* dirY, const float* dirZ, float* t, int* hitObject)
+{
+	const float sizeSquared = s->size * s->size;
+
+	for (unsigned int r = 0; r < count; ++r)
+	{
+		float distX = s->pos.x - startX[r], distY = s->pos.y - startY[r], distZ = s->pos.z - startZ[r];
+		float B = dirX[r] * distX + dirY[r] * distY + dirZ[r] * distZ;
+		float D = B * B - (distX * distX + distY * distY + distZ * distZ) + sizeSquared;
+
+		float root = sqrtf(std::max(D, 0.0f));
+		float t0 = B - root, t1 = B + root;
+
+		// nearer point first, then the further one (e.g. from inside the sphere), with ties going to the lower object number
+		bool hit0 = D >= 0.0f && t0 > EPSILON && (t0 < t[r] || (t0 == t[r] && object < hitObject[r]));
+		bool hit1 = D >= 0.0f && !hit0 && t1 > EPSILON && (t1 < t[r] || (t1 == t[r] && object < hitObject[r]));
+
+		t[r] = hit0 ? t0 : (hit1 ? t1 : t[r]);
+		hitObject[r] = (hit0 || hit1) ? object : hitObject[r];
+	}
+}
+
+
+// closest intersection of a packet of rays with the objects in the scene's hierarchy
+// each box is tested against the whole packet, and the objects in a leaf are tested with the batched tests if any of its rays reach the leaf
+static void bvhIntersectionPacket(const Scene* scene, unsigned int count, const float* startX, const float* startY, const float* startZ,
+	const float* dirX, const float* dirY, const float* dirZ, float* t, int* hitObject)
+{
+	const BvhNode* nodes = scene->bvh->nodes;
+	const unsigned int* objects = scene->bvh->objects;
+	const unsigned int* objectMeshes = scene->bvh->objectMeshes;
+
+	float invX[BVH_PACKET_RAYS], invY[BVH_PACKET_RAYS], invZ[BVH_PACKET_RAYS];
+	for (unsigned int r = 0; r < count; ++r)
+	{
+		invX[r] = 1.0f / (dirX[r] != 0.0f ? dirX[r] : 1e-30f);
+		invY[r] = 1.0f / (dirY[r] != 0.0f ? dirY[r] : 1e-30f);
+		invZ[r] = 1.0f / (dirZ[r] != 0.0f ? dirZ[r] : 1e-30f);
+	}
+
+	// the first ray's direction decides which child is visited first
+	const Vector firstDir = { dirX[0], dirY[0], dirZ[0] };
+
+	unsigned int stack[BVH_MAX_DEPTH];
+	unsigned int depth = 0;
+	unsigned int node = 0;
+
+	for (;;)
+	{
+		const BvhNode* current = &nodes[node];
+
+		// (the same test as getBoxEntry, for every ray at once)
+		bool reached = false;
+		for (unsigned int r = 0; r < count; ++r)
+		{
+			float x0 = (current->boundsMin.x - startX[r]) * invX[r], x1 = (current->boundsMax.x - startX[r]) * invX[r];
+			float y0 = (current->boundsMin.y - startY[r]) * invY[r], y1 = (current->boundsMax.y - startY[r]) * invY[r];
+			float z0 = (current->boundsMin.z - startZ[r]) * invZ[r], z1 = (current->boundsMax.z - startZ[r]) * invZ[r];
+
+			float entry = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::min(z0, z1));
+			float exit = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::max(z0, z1));
+
+			reached |= entry <= exit && exit >= 0.0f && entry <= t[r];
+		}
+
+		if (reached && current->count == 0)
+		{
+			unsigned int first = current->first;
+			const BvhNode* child0 = &nodes[first];
+			const BvhNode* child1 = &nodes[first + 1];
+
+			// visit the child whose centre comes first along the first ray first
+			Vector between = (child1->boundsMin - child0->boundsMin) + (child1->boundsMax - child0->boundsMax);
+			bool swap = firstDir * between < 0.0f;
+
+			stack[depth++] = swap ? first : first + 1;
+			node = swap ? first + 1 : first;
+			continue;
+		}
+
+		if (reached)
+		{
+			for (unsigned int i = 0; i < current->count; ++i)
+			{
+				unsigned int object = objects[current->first + i];
+				if (object < scene->numSpheres)
+				{
+					sphereIntersectionBatch(&scene->sphereContainer[object], (int)object, count, startX, startY, startZ, dirX, dirY, dirZ, t, hitObject);
+					continue;
+				}
+
+				unsigned int index = object - scene->numSpheres;
+				if (index < scene->numTriangles)
+				{
+					const Triangle* tri = &scene->triangleContainer[index];
+					triangleIntersectionBatch(tri->p1, tri->p2, tri->p3, (int)object, count, startX, startY, startZ, dirX, dirY, dirZ, t, hitObject);
+					continue;
+				}
+				index -= scene->numTriangles;
+
+				const Mesh* mesh = &scene->meshContainer[objectMeshes[current->first + i]];
+				index -= mesh->firstTriangle;
+
+				const unsigned int* corners = &mesh->indices[index * 3];
+				triangleIntersectionBatch(getMeshVertex(mesh, corners[0]), getMeshVertex(mesh, corners[1]), getMeshVertex(mesh, corners[2]), (int)object, count,
+					startX, startY, startZ, dirX, dirY, dirZ, t, hitObject);
+			}
+		}
+
+		if (depth == 0) return;
+		node = stack[--depth];
+	}
+}
+
+
+// closest intersection of each of a batch of rays (given as separate arrays of components) with the scene's objects
+// the tests are the same sums as isSphereIntersected and isTriangleIntersected, with the early outs turned into masks
+void objectIntersectionBatch(const Scene* scene, unsigned int count, const float* startX, const float* startY, const float* startZ,
+	const float* dirX, const float* dirY, const float* dirZ, float* t, int* hitObject)
+{
+	for (unsigned int r = 0; r < count; ++r)
+	{
+		t[r] = MAX_RAY_DISTANCE;
+		hitObject[r] = -1;
+	}
+
+	if (scene->bvh != NULL)
+	{
+		for (unsigned int first = 0; first < count; first += BVH_PACKET_RAYS)
+		{
+			bvhIntersectionPacket(scene, std::min(count - first, BVH_PACKET_RAYS), startX + first, startY + first, startZ + first,
+				dirX + first, dirY + first, dirZ + first, t + first, hitObject + first);
+		}
+		return;
+	}
+
+	for (unsigned int i = 0; i < scene->numSpheres; ++i)
+		sphereIntersectionBatch(&scene->sphereContainer[i], (int)i, count, startX, startY, startZ, dirX, dirY, dirZ, t, hitObject);
+
+	for (unsigned int i = 0; i < scene->numTriangles; ++i)
+	{
+		const Triangle* tri = &scene->triangleContainer[i];
+		triangleIntersectionBatch(tri->p1, tri->p2, tri->p3, (int)(scene->numSpheres + i), count, startX, startY, startZ, dirX, dirY, dirZ, t, hitObject);
+	}
+
+	int object = (int)(scene->numSpheres + scene->numTriangles);
+	for (unsigned int m = 0; m < scene->numMeshes; ++m)
+	{
+		const Mesh* mesh = &scene->meshContainer[m];
+
+		for (unsigned int i = 0; i < mesh->numTriangles; ++i, ++object)
+		{
+			const unsigned int* index = &mesh->indices[i * 3];
+			triangleIntersectionBatch(getMeshVertex(mesh, index[0]), getMeshVertex(mesh, index[1]), getMeshVertex(mesh, index[2]), object, count,
+				startX, startY, startZ, dirX, dirY, dirZ, t, hitObject);
+		}
+	}
+}
+
+
+// fill in the object of an intersection from its object number
+// spheres are numbered first, then triangles, then the triangles of each mesh in turn
+void setIntersectionObject(const Scene* scene, int object, Intersection* intersect)
+{
+	unsigned int index = (unsigned int)object;
+
+	if (index < scene->numSpheres)
+	{
+		intersect->objectType = Intersection::SPHERE;
+		intersect->sphere = &scene->sphereContainer[index];
+		return;
+	}
+	index -= scene->numSpheres;
+
+	if (index < scene->numTriangles)
+	{
+		intersect->objectType = Intersection::TRIANGLE;
+		intersect->triangle = &scene->triangleContainer[index];
+		return;
+	}
+	index -= scene->numTriangles;
+
+	intersect->objectType = Intersection::MESH;
+	intersect->mesh = findMeshTriangle(scene, &index);
+	intersect->meshTriangle = index;
+}
@@ -11,12 +11,13 @@
 // all pertinant information about an intersection of a ray with an object
 typedef struct Intersection
 {
-	enum { NONE, SPHERE, TRIANGLE } objectType;			// type of object intersected with
+	enum { NONE, SPHERE, TRIANGLE, MESH } objectType;	// type of object intersected with
 
 	Point pos;											// point of intersection
 	Vector normal;										// normal at point of intersection
 	float viewProjection;								// view projection 
 	bool insideObject;									// whether or not inside an object
+	unsigned int meshTriangle;							// triangle (within the mesh) collided with, for meshes
 
 	Material* material;									// material of object
 
@@ -25,6 +26,7 @@ typedef struct Intersection
 	{
 		struct Sphere* sphere;
 		struct Triangle* triangle;
+		struct Mesh* mesh;
 	};
 } Intersection;
 
@@ -36,11 +38,29 @@ bool isSphereIntersected(const Sphere* s, const Ray* r, float* t);
 // updates closest collision time (/distance) if collision occurs
 bool isTriangleIntersected(const Triangle* tri, const Ray* r, float* t);
 
+// test to see if collision between ray and any of a mesh's triangles happens before time t (equivalent to distance)
+// updates closest collision time (/distance) and the triangle hit if collision occurs, stopping at the first collision found if firstHit is set
+bool isMeshIntersected(const Mesh* mesh, const Ray* r, float* t, bool firstHit, unsigned int* triangle);
+
 // calculate collision normal, viewProjection, object's material, and test to see if inside collision object
 void calculateIntersectionResponse(const Scene* scene, const Ray* viewRay, Intersection* intersect); 
 
-// test to see if collision between ray and any object in the scene
+// test to see if collision between ray and any object in the scene's hierarchy happens before time t (the scene has to have a hierarchy)
+bool isBvhOccluded(const Scene* scene, const Ray* r, float t);
+
+// test to see if collision between ray and any object in the scene (using the scene's hierarchy, if it has one)
 // updates intersection structure if collision occurs
 bool objectIntersection(const Scene* scene, const Ray* viewRay, Intersection* intersect);
 
+// closest intersection of each of a batch of rays (given as separate arrays of components) with the scene's objects
+// the loops run over the objects for the whole batch at once, with no branches per ray, so they vectorise
+// with a hierarchy, the batch is split into packets which walk the hierarchy together, only testing the objects in the boxes some of the packet reach
+// hitObject is set to the object number (see setIntersectionObject), or -1 for a miss (the same objects and distances as objectIntersection)
+void objectIntersectionBatch(const Scene* scene, unsigned int count, const float* startX, const float* startY, const float* startZ,
+	const float* dirX, const float* dirY, const float* dirZ, float* t, int* hitObject);
+
+// fill in the object of an intersection from its object number
+// spheres are numbered first, then triangles, then the triangles of each mesh in turn
+void setIntersectionObject(const Scene* scene, int object, Intersection* intersect);
+
 #endif // __INTERSECTION_H
@@ -0,0 +1,85 @@
+#define NOMINMAX
+#include <windows.h>
+#include <algorithm>
+
+#include "Jobs.h"
+
+
+// jobs shared between threads, along with what each thread needs to know
+struct JobQueue
+{
+	JobFunction run;
+	JobThreadFunction start;
+	JobThreadFunction finish;
+	void* data;
+	unsigned int numJobs;
+	unsigned int* jobCount;			// shared count of the last job allocated to a thread
+};
+
+struct JobThreadData
+{
+	const JobQueue* queue;
+	unsigned int thread;
+};
+
+
+// run jobs until there are none left
+static DWORD __stdcall JobThreadStart(LPVOID threadData)
+{
+	const JobThreadData* data = (JobThreadData*)threadData;
+	const JobQueue* queue = data->queue;
+
+	if (queue->start != NULL) queue->start(queue->data, data->thread);
+
+	unsigned int job;
+	while ((job = InterlockedIncrement(queue->jobCount)) < queue->numJobs)
+	{
+		queue->run(queue->data, job, data->thread);
+	}
+
+	if (queue->finish != NULL) queue->finish(queue->data, data->thread);
+
+	return 0;
+}
+
+
+void runJobs(JobFunction run, void* data, unsigned int numJobs, unsigned int threads)
+{
+	runJobs(run, NULL, NULL, data, numJobs, threads);
+}
+
+
+void runJobs(JobFunction run, JobThreadFunction start, JobThreadFunction finish, void* data, unsigned int numJobs, unsigned int threads)
+{
+	// starts at -1 because we are using InterlockedIncrement
+	unsigned int jobCount = -1;
+	JobQueue queue = { run, start, finish, data, numJobs, &jobCount };
+
+	// small jobs aren't worth starting threads for
+	threads = std::max(std::min(threads, numJobs), 1u);
+	if (threads == 1)
+	{
+		JobThreadData threadData = { &queue, 0 };
+		JobThreadStart(&threadData);
+		return;
+	}
+
+	HANDLE* threadHandles = new HANDLE[threads];
+	JobThreadData* threadData = new JobThreadData[threads];
+
+	for (unsigned int i = 0; i < threads; ++i)
+	{
+		threadData[i].queue = &queue;
+		threadData[i].thread = i;
+		threadHandles[i] = CreateThread(NULL, 0, JobThreadStart, (void*)&threadData[i], 0, NULL);
+	}
+
+	for (unsigned int i = 0; i < threads; ++i)
+	{
+		WaitForSingleObject(threadHandles[i], INFINITE);
+		CloseHandle(threadHandles[i]);
+	}
+
+	delete[] threadHandles;
+	delete[] threadData;
+}
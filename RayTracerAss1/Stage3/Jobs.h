@@ -0,0 +1,17 @@
+#ifndef __JOBS_H
+#define __JOBS_H
+
+// does one of a set of numbered jobs, on the given thread (threads are numbered from 0)
+typedef void (*JobFunction)(void* data, unsigned int job, unsigned int thread);
+
+// sets up or tidies up after a thread that runs jobs
+typedef void (*JobThreadFunction)(void* data, unsigned int thread);
+
+// run all the numbered jobs (run(data, job, thread) for each), handing them out one at a time to the given number of threads
+// fewer threads are used when there are fewer jobs than threads, and with a single thread the jobs are run on the calling thread
+void runJobs(JobFunction run, void* data, unsigned int numJobs, unsigned int threads);
+
+// as above, with each thread calling start before its first job and finish after its last (either can be NULL)
+void runJobs(JobFunction run, JobThreadFunction start, JobThreadFunction finish, void* data, unsigned int numJobs, unsigned int threads);
+
+#endif // __JOBS_H
@@ -6,6 +6,12 @@ It is free to use for educational purpose and cannot be redistributed outside of
 #include "Colour.h"
 #include "Intersection.h"
 #include "Texturing.h"
+#include "FastMath.h"
+#include "ShadowMap.h"
+#include "TextureCache.h"
+
+// largest specular power handled by repeated squaring (anything above uses the general approximation)
+const float MAX_INTEGER_SPECULAR_POWER = 1024.0f;
 
 // test to see if light ray collides with any of the scene's objects
 // short-circuits when first intersection discovered, because no matter what the object will be in shadow
@@ -13,6 +19,9 @@ bool isInShadow(const Scene* scene, const Ray* lightRay, const float lightDist)
 {
 	float t = lightDist;
 
+	// only the objects in the boxes the ray passes through are tested when the scene has a hierarchy
+	if (scene->bvh != NULL) return isBvhOccluded(scene, lightRay, lightDist);
+
 	// search for sphere collision
 	for (unsigned int i = 0; i < scene->numSpheres; ++i)
 	{
@@ -31,16 +40,45 @@ bool isInShadow(const Scene* scene, const Ray* lightRay, const float lightDist)
 		}
 	}
 
+	// search for mesh collision
+	for (unsigned int m = 0; m < scene->numMeshes; ++m)
+	{
+		unsigned int triangle;
+		if (isMeshIntersected(&scene->meshContainer[m], lightRay, &t, true, &triangle))
+		{
+			return true;
+		}
+	}
+
 	// not in shadow
 	return false;
 }
 
 
-// apply diffuse lighting with respect to material's colouring
-Colour applyDiffuse(const Ray* lightRay, const Light* currentLight, const Intersection* intersect)
+// fraction of a light reaching the intersection (traces a shadow ray, or uses the light's shadow map if the scene has them)
+float getLightVisibility(const Scene* scene, unsigned int lightIndex, const Ray* lightRay, const float lightDist, const Vector* normal)
+{
+	if (scene->shadowMapContainer != NULL)
+	{
+		return getShadowMapVisibility(&scene->shadowMapContainer[lightIndex], &scene->lightContainer[lightIndex], &lightRay->start, normal, lightDist);
+	}
+
+	return isInShadow(scene, lightRay, lightDist) ? 0.0f : 1.0f;
+}
+
+
+// colour of the material at the point of intersection (before any lighting is applied)
+Colour applyTexture(const Intersection* intersect)
 {
 	Colour output;
 
+	// use the baked texture if the point is (or can be) cached
+	if (intersect->material->textureCache != NULL)
+	{
+		int which = lookupTextureCache(intersect->material->textureCache, &intersect->pos);
+		if (which >= 0) return (which ? intersect->material->diffuse : intersect->material->diffuse2);
+	}
+
 	switch (intersect->material->type)
 	{
 	case Material::GOURAUD:
@@ -57,21 +95,73 @@ Colour applyDiffuse(const Ray* lightRay, const Light* currentLight, const Inters
 		break;
 	}
 
+	return output;
+}
+
+
+// apply diffuse lighting with respect to material's colouring
+Colour applyDiffuse(const Ray* lightRay, const Light* currentLight, const Intersection* intersect)
+{
+	Colour output = applyTexture(intersect);
+
 	float lambert = lightRay->dir * intersect->normal;
 
 	return lambert * currentLight->intensity * output;
 }
 
 
+// pick the cheapest way of raising to the material's specular power
+// most materials use small integer powers, which can be done exactly by repeated squaring instead of powf
+void selectSpecularEvaluator(Material* material)
+{
+	if (material->specular.red == 0.0f && material->specular.green == 0.0f && material->specular.blue == 0.0f)
+	{
+		// no specular colour, so no specular contribution whatever the power
+		material->specularType = Material::SPECULAR_NONE;
+	}
+	else if (material->power >= 0.0f && material->power <= MAX_INTEGER_SPECULAR_POWER && material->power == floorf(material->power))
+	{
+		material->specularType = Material::SPECULAR_INTEGER;
+		material->integerPower = (unsigned int)material->power;
+	}
+	else
+	{
+		material->specularType = Material::SPECULAR_GENERAL;
+	}
+}
+
+
+// raise the Blinn coefficient to the material's specular power using the evaluator picked at load
+float applySpecularPower(const Material* material, float blinn)
+{
+	switch (material->specularType)
+	{
+	case Material::SPECULAR_INTEGER:
+		return powi(blinn, material->integerPower);
+	case Material::SPECULAR_GENERAL:
+		return fastPow(blinn, material->power);
+	default:
+		return 0.0f;
+	}
+}
+
+
 // Blinn 
 // The direction of Blinn is exactly at mid point of the light ray and the view ray. 
 // We compute the Blinn vector and then we normalize it then we compute the coeficient of blinn
 // which is the specular contribution of the current light.
 Colour applySpecular(const Ray* lightRay, const Light* currentLight, const float fLightProjection, const Ray* viewRay, const Intersection* intersect)
 {
+	const Material* material = intersect->material;
+
+	if (material->specularType == Material::SPECULAR_NONE)
+	{
+		return Colour(0.0f, 0.0f, 0.0f);
+	}
+
 	Vector blinnDir = lightRay->dir - viewRay->dir;
 	float blinn = invsqrtf(blinnDir.dot()) * std::max(fLightProjection - intersect->viewProjection, 0.0f);
-	blinn = powf(blinn, intersect->material->power);
+	blinn = applySpecularPower(material, blinn);
 
 	return blinn * intersect->material->specular * currentLight->intensity;
 }
@@ -114,14 +204,15 @@ Colour applyLighting(const Scene* scene, const Ray* viewRay, const Intersection*
 		// normalise the light direction
 		lightRay.dir = lightRay.dir * invLightDist;
 
-		// only apply lighting from this light if not in shadow of some other object
-		if (!isInShadow(scene, &lightRay, lightDist))
+		// only apply lighting from this light if not (completely) in shadow of some other object
+		float visibility = getLightVisibility(scene, j, &lightRay, lightDist, &intersect->normal);
+		if (visibility > 0.0f)
 		{
 			// add diffuse lighting from colour / texture
-			output += applyDiffuse(&lightRay, currentLight, intersect);
+			output += visibility * applyDiffuse(&lightRay, currentLight, intersect);
 
 			// add specular lighting
-			output += applySpecular(&lightRay, currentLight, lightProjection, viewRay, intersect);
+			output += visibility * applySpecular(&lightRay, currentLight, lightProjection, viewRay, intersect);
 		}
 	}
 
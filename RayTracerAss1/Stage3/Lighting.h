@@ -11,9 +11,21 @@
 // test to see if light ray collides with any of the scene's objects
 bool isInShadow(const Scene* scene, const Ray* lightRay, const float lightDist);
 
+// fraction of a light reaching the intersection (traces a shadow ray, or uses the light's shadow map if the scene has them)
+float getLightVisibility(const Scene* scene, unsigned int lightIndex, const Ray* lightRay, const float lightDist, const Vector* normal);
+
+// colour of the material at the point of intersection (before any lighting is applied)
+Colour applyTexture(const Intersection* intersect);
+
 // apply diffuse lighting with respect to material's colouring
 Colour applyDiffuse(const Ray* lightRay, const Light* currentLight, const Intersection* intersect);
 
+// pick the cheapest way of raising to the material's specular power (call once the material is loaded)
+void selectSpecularEvaluator(Material* material);
+
+// raise the Blinn coefficient to the material's specular power using the evaluator picked at load
+float applySpecularPower(const Material* material, float blinn);
+
 // apply specular lighting using Blinn
 Colour applySpecular(const Ray* lightRay, const Light* currentLight, const float fLightProjection, const Ray* viewRay, const Intersection* intersect);
 
@@ -0,0 +1,168 @@
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+
+#include "Mesh.h"
+
+// largest quantized step along an axis
+const unsigned int MESH_QUANTIZED_STEPS = 65535;
+
+// bit pattern of a point, so identical corners can be found with a hash table
+struct VertexKey
+{
+	unsigned int x, y, z;
+
+	bool operator == (const VertexKey& other) const
+	{
+		return x == other.x && y == other.y && z == other.z;
+	}
+};
+
+struct VertexKeyHash
+{
+	size_t operator () (const VertexKey& key) const
+	{
+		return (key.x * 73856093u) ^ (key.y * 19349663u) ^ (key.z * 83492791u);
+	}
+};
+
+
+// build a mesh from a run of triangles, sharing a vertex between all of the corners at exactly the same position
+static void weldTriangles(const Triangle* triangles, unsigned int count, SceneArena* arena, Mesh* mesh)
+{
+	typedef std::unordered_map<VertexKey, unsigned int, VertexKeyHash> VertexMap;
+	VertexMap vertexIndex;
+	vertexIndex.reserve(count * 3);
+
+	std::vector<Point> vertices;
+	mesh->numTriangles = count;
+	mesh->indices = (unsigned int*)allocateSceneArena(arena, (size_t)count * 3 * sizeof(unsigned int));
+
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		const Point* corners[3] = { &triangles[i].p1, &triangles[i].p2, &triangles[i].p3 };
+		for (int k = 0; k < 3; ++k)
+		{
+			VertexKey key;
+			memcpy(&key.x, &corners[k]->x, sizeof(float));
+			memcpy(&key.y, &corners[k]->y, sizeof(float));
+			memcpy(&key.z, &corners[k]->z, sizeof(float));
+
+			// vertices are numbered in the order they're first used
+			std::pair<VertexMap::iterator, bool> found = vertexIndex.insert(std::make_pair(key, (unsigned int)vertices.size()));
+			if (found.second) vertices.push_back(*corners[k]);
+
+			mesh->indices[i * 3 + k] = found.first->second;
+		}
+	}
+
+	mesh->numVertices = (unsigned int)vertices.size();
+	mesh->vertices = (Point*)allocateSceneArena(arena, (size_t)mesh->numVertices * sizeof(Point));
+	std::copy(vertices.begin(), vertices.end(), mesh->vertices);
+	mesh->quantized = NULL;
+	mesh->materialId = triangles[0].materialId;
+}
+
+
+// weld the scene's triangles into indexed meshes (one per run of triangles sharing a material)
+void indexSceneTriangles(Scene* scene)
+{
+	if (scene->numTriangles == 0) return;
+
+	// count the runs (each model's triangles are together, so this is usually one run per model)
+	unsigned int numRuns = 1;
+	for (unsigned int i = 1; i < scene->numTriangles; ++i)
+		numRuns += scene->triangleContainer[i].materialId != scene->triangleContainer[i - 1].materialId;
+
+	Mesh* meshes = (Mesh*)allocateSceneArena(&scene->arena, (scene->numMeshes + numRuns) * sizeof(Mesh));
+	std::copy(scene->meshContainer, scene->meshContainer + scene->numMeshes, meshes);
+
+	Mesh* mesh = &meshes[scene->numMeshes];
+	unsigned int start = 0;
+	for (unsigned int i = 1; i <= scene->numTriangles; ++i)
+	{
+		if (i < scene->numTriangles && scene->triangleContainer[i].materialId == scene->triangleContainer[start].materialId) continue;
+
+		weldTriangles(&scene->triangleContainer[start], i - start, &scene->arena, mesh++);
+		start = i;
+	}
+
+	// the triangles in a cached scene belong to the cache's mapping
+	if (scene->cacheView == NULL) releaseSceneArena(&scene->arena, scene->triangleContainer, (size_t)scene->numTriangles * sizeof(Triangle));
+	releaseSceneArena(&scene->arena, scene->meshContainer, scene->numMeshes * sizeof(Mesh));
+
+	scene->triangleContainer = NULL;
+	scene->numTriangles = 0;
+	scene->meshContainer = meshes;
+	scene->numMeshes += numRuns;
+	numberMeshTriangles(scene);
+}
+
+
+// number each mesh's first triangle
+void numberMeshTriangles(Scene* scene)
+{
+	unsigned int first = 0;
+	for (unsigned int m = 0; m < scene->numMeshes; ++m)
+	{
+		scene->meshContainer[m].firstTriangle = first;
+		first += scene->meshContainer[m].numTriangles;
+	}
+}
+
+
+// store a mesh's vertices as 16 bit steps across its bounds
+void quantizeMesh(SceneArena* arena, Mesh* mesh)
+{
+	if (mesh->quantized != NULL || mesh->numVertices == 0) return;
+
+	Point boundsMin = mesh->vertices[0], boundsMax = mesh->vertices[0];
+	for (unsigned int i = 1; i < mesh->numVertices; ++i)
+	{
+		const Point& vertex = mesh->vertices[i];
+		boundsMin = Point{ std::min(boundsMin.x, vertex.x), std::min(boundsMin.y, vertex.y), std::min(boundsMin.z, vertex.z) };
+		boundsMax = Point{ std::max(boundsMax.x, vertex.x), std::max(boundsMax.y, vertex.y), std::max(boundsMax.z, vertex.z) };
+	}
+
+	mesh->origin = boundsMin;
+	mesh->step = (boundsMax - boundsMin) * (1.0f / MESH_QUANTIZED_STEPS);
+
+	// flat meshes have no extent along some axis (every vertex is at step 0 along it)
+	const float invStep[3] = { mesh->step.x > 0.0f ? 1.0f / mesh->step.x : 0.0f, mesh->step.y > 0.0f ? 1.0f / mesh->step.y : 0.0f,
+		mesh->step.z > 0.0f ? 1.0f / mesh->step.z : 0.0f };
+
+	mesh->quantized = (unsigned short*)allocateSceneArena(arena, (size_t)mesh->numVertices * 3 * sizeof(unsigned short));
+	for (unsigned int i = 0; i < mesh->numVertices; ++i)
+	{
+		const float offsets[3] = { mesh->vertices[i].x - boundsMin.x, mesh->vertices[i].y - boundsMin.y, mesh->vertices[i].z - boundsMin.z };
+		for (int k = 0; k < 3; ++k)
+		{
+			float steps = floorf(offsets[k] * invStep[k] + 0.5f);
+			mesh->quantized[i * 3 + k] = (unsigned short)std::min(std::max(steps, 0.0f), (float)MESH_QUANTIZED_STEPS);
+		}
+	}
+
+	releaseSceneArena(arena, mesh->vertices, (size_t)mesh->numVertices * sizeof(Point));
+	mesh->vertices = NULL;
+}
+
+
+// memory used by a mesh's vertices and indices
+size_t getMeshBytes(const Mesh* mesh)
+{
+	size_t vertexBytes = mesh->quantized != NULL ? 3 * sizeof(unsigned short) : sizeof(Point);
+	return (size_t)mesh->numVertices * vertexBytes + (size_t)mesh->numTriangles * 3 * sizeof(unsigned int);
+}
+
+
+// memory used by all the scene's triangles and meshes
+size_t getGeometryBytes(const Scene* scene)
+{
+	size_t bytes = (size_t)scene->numTriangles * sizeof(Triangle);
+	for (unsigned int m = 0; m < scene->numMeshes; ++m)
+		bytes += getMeshBytes(&scene->meshContainer[m]);
+
+	return bytes;
+}
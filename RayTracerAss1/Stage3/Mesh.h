@@ -0,0 +1,39 @@
+#ifndef __MESH_H
+#define __MESH_H
+
+#include "Scene.h"
+
+// weld the scene's triangles into indexed meshes (one per run of triangles sharing a material), with identical corners becoming shared vertices
+// the meshes are added after any the scene already has, and the triangles are removed (and their memory released, unless they're in the scene cache)
+void indexSceneTriangles(Scene* scene);
+
+// number each mesh's first triangle (Mesh::firstTriangle), once the scene's meshes are all loaded
+void numberMeshTriangles(Scene* scene);
+
+// find the mesh holding a triangle, numbered across all the scene's meshes in turn, by binary searching the meshes' first triangles
+// the number becomes the triangle's index within the mesh
+inline Mesh* findMeshTriangle(const Scene* scene, unsigned int* triangle)
+{
+	// (halving the range without branching, as there's no telling which way the search will go)
+	Mesh* mesh = scene->meshContainer;
+	for (unsigned int count = scene->numMeshes; count > 1; count -= count / 2)
+	{
+		Mesh* middle = mesh + count / 2;
+		mesh = (middle->firstTriangle <= *triangle) ? middle : mesh;
+	}
+
+	*triangle -= mesh->firstTriangle;
+	return mesh;
+}
+
+// store a mesh's vertices as 16 bit steps across its bounds (allocated from the given arena, which the full precision vertices are released back to)
+// vertices move by up to half a step, which is the mesh's size along an axis / 131070
+void quantizeMesh(SceneArena* arena, Mesh* mesh);
+
+// memory used by a mesh's vertices and indices
+size_t getMeshBytes(const Mesh* mesh);
+
+// memory used by all the scene's triangles and meshes
+size_t getGeometryBytes(const Scene* scene);
+
+#endif // __MESH_H
@@ -0,0 +1,917 @@
+#define TARGET_WINDOWS
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <cmath>
+#include <algorithm>
+
+#include "MeshFile.h"
+#include "Jobs.h"
+#include "CacheFile.h"
+#include "Mesh.h"
+#include "Timer.h"
+
+#pragma warning(disable: 4996)
+
+// bytes of an OBJ file handed to a thread at a time (rounded to whole lines)
+const size_t MESH_BLOCK_BYTES = 1 << 20;
+
+// vertices or faces handed to a thread at a time
+const unsigned int MESH_BLOCK_ITEMS = 1 << 16;
+
+// powers of ten that are exactly representable as doubles
+static const double POWERS_OF_TEN[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+
+// whether a file name ends with the given (lower case) extension, ignoring case
+static bool hasExtension(const char* fileName, const char* extension)
+{
+	size_t nameLength = strlen(fileName), extensionLength = strlen(extension);
+	if (nameLength < extensionLength) return false;
+
+	for (size_t i = 0; i < extensionLength; ++i)
+	{
+		if (tolower((unsigned char)fileName[nameLength - extensionLength + i]) != extension[i]) return false;
+	}
+
+	return true;
+}
+
+
+// text parsing (the mapped file isn't null terminated, so every read is checked against the end)
+
+static inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline void skipSpaces(const char*& p, const char* end)
+{
+	while (p < end && isSpace(*p)) ++p;
+}
+
+// read a decimal number (with optional fraction and exponent), returns false if there isn't one
+static bool parseFloat(const char*& p, const char* end, float* value)
+{
+	skipSpaces(p, end);
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+	// up to 19 significant digits are kept (which is plenty for a float), the rest only move the decimal point
+	unsigned long long mantissa = 0;
+	int exponent = 0, digits = 0;
+	bool found = false;
+
+	for (; p < end && isDigit(*p); ++p)
+	{
+		found = true;
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0;
+		}
+		else
+		{
+			exponent++;
+		}
+	}
+
+	if (p < end && *p == '.')
+	{
+		for (++p; p < end && isDigit(*p); ++p)
+		{
+			found = true;
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+				exponent--;
+			}
+		}
+	}
+
+	if (!found) return false;
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char* q = p + 1;
+		bool negativeExponent = false;
+		if (q < end && (*q == '-' || *q == '+')) negativeExponent = *q++ == '-';
+
+		if (q < end && isDigit(*q))
+		{
+			int e = 0;
+			for (; q < end && isDigit(*q); ++q)
+				e = std::min(e * 10 + (*q - '0'), 100000);
+
+			exponent += negativeExponent ? -e : e;
+			p = q;
+		}
+	}
+
+	double result = (double)mantissa;
+	if (exponent < 0)
+		result = exponent >= -22 ? result / POWERS_OF_TEN[-exponent] : result * pow(10.0, exponent);
+	else if (exponent > 0)
+		result = exponent <= 22 ? result * POWERS_OF_TEN[exponent] : result * pow(10.0, exponent);
+
+	*value = (float)(negative ? -result : result);
+	return true;
+}
+
+// read a whole number, returns false if there isn't one
+static bool parseInteger(const char*& p, const char* end, long long* value)
+{
+	skipSpaces(p, end);
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+	if (p == end || !isDigit(*p)) return false;
+
+	long long result = 0;
+	for (; p < end && isDigit(*p); ++p)
+		result = std::min(result * 10 + (*p - '0'), 1ll << 40);
+
+	*value = negative ? -result : result;
+	return true;
+}
+
+
+// OBJ files
+// the file is split into blocks of whole lines, which are scanned twice: once to count their vertices and triangles
+// (so each block knows where its output goes), then again to parse them straight into the mesh
+
+// a run of lines from an OBJ file
+struct ObjBlock
+{
+	const char* start;
+	const char* end;
+	unsigned int numVertices;		// "v" lines in the block
+	unsigned long long numTriangles;	// triangles made from the block's "f" lines
+	unsigned int firstVertex;		// number of the block's first vertex within the whole file
+	unsigned int firstTriangle;		// number of the block's first triangle within the whole file
+};
+
+// data shared by the threads reading an OBJ file
+struct ObjData
+{
+	ObjBlock* blocks;
+	Mesh* mesh;
+	unsigned int malformedLines;	// shared count of lines that couldn't be read
+};
+
+// kind of an OBJ line (only vertex positions and faces are used, everything else is skipped)
+enum ObjLine { OBJ_OTHER, OBJ_VERTEX, OBJ_FACE };
+
+// work out what kind a line is, moving past its keyword
+static ObjLine getObjLine(const char*& p, const char* end)
+{
+	skipSpaces(p, end);
+	if (end - p < 2 || !isSpace(p[1])) return OBJ_OTHER;
+
+	if (p[0] == 'v') { p += 2; return OBJ_VERTEX; }
+	if (p[0] == 'f') { p += 2; return OBJ_FACE; }
+	return OBJ_OTHER;
+}
+
+// end of a line's contents, which stop at a comment ("#" to the end of the line)
+static const char* getObjContentEnd(const char* line, const char* lineEnd)
+{
+	const char* comment = (const char*)memchr(line, '#', lineEnd - line);
+	return comment != NULL ? comment : lineEnd;
+}
+
+// count the vertices and triangles in a block
+static void countObjBlock(void* threadData, unsigned int blockIndex, unsigned int thread)
+{
+	ObjBlock* block = &((ObjData*)threadData)->blocks[blockIndex];
+	block->numVertices = 0;
+	block->numTriangles = 0;
+
+	for (const char* line = block->start; line < block->end; )
+	{
+		const char* lineEnd = (const char*)memchr(line, '\n', block->end - line);
+		if (lineEnd == NULL) lineEnd = block->end;
+
+		const char* contentEnd = getObjContentEnd(line, lineEnd);
+		const char* p = line;
+		switch (getObjLine(p, contentEnd))
+		{
+		case OBJ_VERTEX:
+			block->numVertices++;
+			break;
+		case OBJ_FACE:
+		{
+			// count the face's vertex references (a fan of n vertices makes n - 2 triangles)
+			unsigned int refs = 0;
+			for (;;)
+			{
+				skipSpaces(p, contentEnd);
+				if (p == contentEnd) break;
+				refs++;
+				while (p < contentEnd && !isSpace(*p)) ++p;
+			}
+			if (refs >= 3) block->numTriangles += refs - 2;
+			break;
+		}
+		default:
+			break;
+		}
+
+		line = lineEnd + 1;
+	}
+}
+
+// read a face's vertex reference ("v", "v/vt", "v//vn" or "v/vt/vn") as an index into the mesh's vertices
+// negative references count back from the last vertex read before the face
+static bool parseObjReference(const char*& p, const char* end, unsigned int verticesSoFar, unsigned int numVertices, unsigned int* index)
+{
+	long long reference;
+	if (!parseInteger(p, end, &reference)) return false;
+	while (p < end && !isSpace(*p)) ++p;
+
+	long long vertex = reference > 0 ? reference - 1 : (long long)verticesSoFar + reference;
+	if (reference == 0 || vertex < 0 || vertex >= numVertices) return false;
+
+	*index = (unsigned int)vertex;
+	return true;
+}
+
+// parse the vertices and triangles of a block into the mesh
+static void parseObjBlock(void* threadData, unsigned int blockIndex, unsigned int thread)
+{
+	ObjData* data = (ObjData*)threadData;
+	const ObjBlock* block = &data->blocks[blockIndex];
+	Mesh* mesh = data->mesh;
+
+	Point* vertex = &mesh->vertices[block->firstVertex];
+	unsigned int* indices = &mesh->indices[block->firstTriangle * 3];
+	unsigned int verticesSoFar = block->firstVertex;
+
+	for (const char* line = block->start; line < block->end; )
+	{
+		const char* lineEnd = (const char*)memchr(line, '\n', block->end - line);
+		if (lineEnd == NULL) lineEnd = block->end;
+
+		const char* contentEnd = getObjContentEnd(line, lineEnd);
+		const char* p = line;
+		switch (getObjLine(p, contentEnd))
+		{
+		case OBJ_VERTEX:
+			if (!parseFloat(p, contentEnd, &vertex->x) || !parseFloat(p, contentEnd, &vertex->y) || !parseFloat(p, contentEnd, &vertex->z))
+			{
+				*vertex = { 0.0f, 0.0f, 0.0f };
+				InterlockedIncrement(&data->malformedLines);
+			}
+			vertex++;
+			verticesSoFar++;
+			break;
+		case OBJ_FACE:
+		{
+			// split the face into a fan of triangles around its first vertex (every triangle the count pass found is filled in,
+			// bad references are replaced by the first vertex so they make degenerate triangles)
+			unsigned int first = 0, previous = 0, refs = 0;
+			bool malformed = false;
+			for (;;)
+			{
+				skipSpaces(p, contentEnd);
+				if (p == contentEnd) break;
+
+				unsigned int index;
+				if (!parseObjReference(p, contentEnd, verticesSoFar, mesh->numVertices, &index))
+				{
+					while (p < contentEnd && !isSpace(*p)) ++p;
+					index = first;
+					malformed = true;
+				}
+
+				if (refs == 0)
+				{
+					first = index;
+				}
+				else if (refs >= 2)
+				{
+					indices[0] = first;
+					indices[1] = previous;
+					indices[2] = index;
+					indices += 3;
+				}
+
+				previous = index;
+				refs++;
+			}
+			if (malformed) InterlockedIncrement(&data->malformedLines);
+			break;
+		}
+		default:
+			break;
+		}
+
+		line = lineEnd + 1;
+	}
+}
+
+// read an OBJ file's vertices and faces into a mesh
+static bool loadObj(const char* fileName, const char* file, size_t size, unsigned int threads, SceneArena* arena, Mesh* mesh)
+{
+	// split the file into blocks which each start at the beginning of a line
+	unsigned int numBlocks = (unsigned int)((size + MESH_BLOCK_BYTES - 1) / MESH_BLOCK_BYTES);
+	ObjBlock* blocks = new ObjBlock[numBlocks];
+	const char* fileEnd = file + size;
+
+	for (unsigned int b = 0; b < numBlocks; ++b)
+	{
+		const char* start = file + (size_t)b * MESH_BLOCK_BYTES;
+		if (b > 0 && start[-1] != '\n')
+		{
+			start = (const char*)memchr(start, '\n', fileEnd - start);
+			start = start != NULL ? start + 1 : fileEnd;
+		}
+
+		// (a block can end up empty if a single line is longer than a block)
+		blocks[b].start = b > 0 ? std::max(start, blocks[b - 1].start) : file;
+		if (b > 0) blocks[b - 1].end = blocks[b].start;
+	}
+	blocks[numBlocks - 1].end = fileEnd;
+
+	ObjData data = { blocks, mesh, 0 };
+	runJobs(countObjBlock, &data, numBlocks, threads);
+
+	// work out where each block's vertices and triangles go
+	unsigned long long numVertices = 0, numTriangles = 0;
+	for (unsigned int b = 0; b < numBlocks; ++b)
+	{
+		blocks[b].firstVertex = (unsigned int)numVertices;
+		blocks[b].firstTriangle = (unsigned int)numTriangles;
+		numVertices += blocks[b].numVertices;
+		numTriangles += blocks[b].numTriangles;
+	}
+
+	if (numVertices > 0xFFFFFFFFull || numTriangles * 3 > 0xFFFFFFFFull)
+	{
+		fprintf(stderr, "Mesh file %s: too many vertices or triangles.\n", fileName);
+		delete[] blocks;
+		return false;
+	}
+
+	mesh->numVertices = (unsigned int)numVertices;
+	mesh->numTriangles = (unsigned int)numTriangles;
+	mesh->vertices = (Point*)allocateSceneArena(arena, (size_t)mesh->numVertices * sizeof(Point));
+	mesh->indices = (unsigned int*)allocateSceneArena(arena, (size_t)mesh->numTriangles * 3 * sizeof(unsigned int));
+
+	runJobs(parseObjBlock, &data, numBlocks, threads);
+	delete[] blocks;
+
+	if (data.malformedLines > 0)
+	{
+		fprintf(stderr, "Mesh file %s: %u malformed vertex or face lines.\n", fileName, data.malformedLines);
+		return false;
+	}
+
+	return true;
+}
+
+
+// PLY files
+// only binary little endian files are read, with float (or double) vertex positions and a list of vertex indices per face
+
+enum PlyType { PLY_NONE, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64 };
+
+static const unsigned int PLY_TYPE_SIZES[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+
+const unsigned int PLY_MAX_ELEMENTS = 8;
+const unsigned int PLY_MAX_PROPERTIES = 16;
+
+typedef struct PlyProperty
+{
+	char name[32];
+	PlyType type;					// type of the property (or of a list's items)
+	PlyType countType;				// type of a list's item count (PLY_NONE if the property isn't a list)
+} PlyProperty;
+
+typedef struct PlyElement
+{
+	char name[32];
+	unsigned long long count;
+	PlyProperty properties[PLY_MAX_PROPERTIES];
+	unsigned int numProperties;
+} PlyElement;
+
+// data shared by the threads reading a PLY file
+struct PlyData
+{
+	Mesh* mesh;
+	const unsigned char* vertexData;	// first vertex record
+	unsigned int vertexStride;			// size of a vertex record
+	unsigned int offsets[3];			// position of x, y and z within a vertex record
+	PlyType positionTypes[3];			// types of x, y and z
+	const unsigned char* faceData;		// first face record
+	PlyType countType;					// type of a face's vertex count
+	PlyType indexType;					// type of a face's vertex indices
+	unsigned int badFaces;				// shared count of faces that weren't triangles (only used by the fast path)
+	unsigned int badIndices;			// shared count of faces with indices past the last vertex
+};
+
+static PlyType getPlyType(const char* name)
+{
+	static const char* names[][2] = { { "", "" }, { "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+		{ "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" } };
+
+	for (int t = PLY_INT8; t <= PLY_FLOAT64; ++t)
+	{
+		if (strcmp(name, names[t][0]) == 0 || strcmp(name, names[t][1]) == 0) return (PlyType)t;
+	}
+
+	return PLY_NONE;
+}
+
+// read a (little endian) value of the given type
+static inline double readPlyValue(const unsigned char* p, PlyType type)
+{
+	switch (type)
+	{
+	case PLY_INT8: return (double)(signed char)p[0];
+	case PLY_UINT8: return (double)p[0];
+	case PLY_INT16: { short v; memcpy(&v, p, sizeof(v)); return (double)v; }
+	case PLY_UINT16: { unsigned short v; memcpy(&v, p, sizeof(v)); return (double)v; }
+	case PLY_INT32: { int v; memcpy(&v, p, sizeof(v)); return (double)v; }
+	case PLY_UINT32: { unsigned int v; memcpy(&v, p, sizeof(v)); return (double)v; }
+	case PLY_FLOAT32: { float v; memcpy(&v, p, sizeof(v)); return (double)v; }
+	case PLY_FLOAT64: { double v; memcpy(&v, p, sizeof(v)); return v; }
+	default: return 0.0;
+	}
+}
+
+// read a (little endian) count or vertex index, negative values come back as -1
+static inline long long readPlyInteger(const unsigned char* p, PlyType type)
+{
+	switch (type)
+	{
+	case PLY_INT8: return std::max((long long)(signed char)p[0], -1ll);
+	case PLY_UINT8: return p[0];
+	case PLY_INT16: { short v; memcpy(&v, p, sizeof(v)); return std::max((long long)v, -1ll); }
+	case PLY_UINT16: { unsigned short v; memcpy(&v, p, sizeof(v)); return v; }
+	case PLY_INT32: { int v; memcpy(&v, p, sizeof(v)); return std::max((long long)v, -1ll); }
+	case PLY_UINT32: { unsigned int v; memcpy(&v, p, sizeof(v)); return v; }
+	default: return -1;
+	}
+}
+
+// read the header, filling in the elements, returns the first byte after the header (or NULL if the header isn't valid)
+static const char* readPlyHeader(const char* fileName, const char* file, size_t size, PlyElement* elements, unsigned int* numElements)
+{
+	const char* fileEnd = file + size;
+	const char* line = file;
+	unsigned int lineNumber = 0;
+	*numElements = 0;
+
+	while (line < fileEnd)
+	{
+		const char* lineEnd = (const char*)memchr(line, '\n', fileEnd - line);
+		if (lineEnd == NULL) break;
+
+		// split the line into words (header lines are short, so a copy is fine)
+		char text[256];
+		size_t length = std::min((size_t)(lineEnd - line), sizeof(text) - 1);
+		memcpy(text, line, length);
+		text[length] = '\0';
+		line = lineEnd + 1;
+
+		char* words[8];
+		unsigned int numWords = 0;
+		for (char* word = strtok(text, " \t\r"); word != NULL && numWords < 8; word = strtok(NULL, " \t\r"))
+			words[numWords++] = word;
+
+		if (lineNumber++ == 0)
+		{
+			if (numWords != 1 || strcmp(words[0], "ply") != 0) break;
+			continue;
+		}
+		if (numWords == 0) continue;
+
+		if (strcmp(words[0], "end_header") == 0)
+		{
+			return line;
+		}
+		else if (strcmp(words[0], "format") == 0)
+		{
+			if (numWords < 2 || strcmp(words[1], "binary_little_endian") != 0)
+			{
+				fprintf(stderr, "Mesh file %s: only binary little endian PLY files can be read.\n", fileName);
+				return NULL;
+			}
+		}
+		else if (strcmp(words[0], "element") == 0)
+		{
+			if (numWords != 3 || *numElements == PLY_MAX_ELEMENTS) break;
+
+			PlyElement* element = &elements[(*numElements)++];
+			snprintf(element->name, sizeof(element->name), "%s", words[1]);
+			element->count = strtoull(words[2], NULL, 10);
+			element->numProperties = 0;
+		}
+		else if (strcmp(words[0], "property") == 0)
+		{
+			if (*numElements == 0) break;
+
+			PlyElement* element = &elements[*numElements - 1];
+			if (element->numProperties == PLY_MAX_PROPERTIES) break;
+
+			PlyProperty* property = &element->properties[element->numProperties++];
+			if (numWords == 5 && strcmp(words[1], "list") == 0)
+			{
+				property->countType = getPlyType(words[2]);
+				property->type = getPlyType(words[3]);
+				snprintf(property->name, sizeof(property->name), "%s", words[4]);
+				if (property->countType == PLY_NONE || property->countType >= PLY_FLOAT32 || property->type == PLY_NONE) break;
+			}
+			else if (numWords == 3)
+			{
+				property->countType = PLY_NONE;
+				property->type = getPlyType(words[1]);
+				snprintf(property->name, sizeof(property->name), "%s", words[2]);
+				if (property->type == PLY_NONE) break;
+			}
+			else
+			{
+				break;
+			}
+		}
+		// anything else (comments and obj_info) is skipped
+	}
+
+	fprintf(stderr, "Mesh file %s: malformed PLY header.\n", fileName);
+	return NULL;
+}
+
+// read a block of vertex positions
+static void readPlyVertices(void* threadData, unsigned int block, unsigned int thread)
+{
+	const PlyData* data = (const PlyData*)threadData;
+	unsigned int first = block * MESH_BLOCK_ITEMS;
+	unsigned int last = std::min(first + MESH_BLOCK_ITEMS, data->mesh->numVertices);
+
+	const unsigned char* record = data->vertexData + (size_t)first * data->vertexStride;
+	for (unsigned int i = first; i < last; ++i, record += data->vertexStride)
+	{
+		Point& vertex = data->mesh->vertices[i];
+
+		// single precision positions (nearly always the case) are copied straight out
+		if (data->positionTypes[0] == PLY_FLOAT32 && data->positionTypes[1] == PLY_FLOAT32 && data->positionTypes[2] == PLY_FLOAT32)
+		{
+			memcpy(&vertex.x, record + data->offsets[0], sizeof(float));
+			memcpy(&vertex.y, record + data->offsets[1], sizeof(float));
+			memcpy(&vertex.z, record + data->offsets[2], sizeof(float));
+		}
+		else
+		{
+			vertex.x = (float)readPlyValue(record + data->offsets[0], data->positionTypes[0]);
+			vertex.y = (float)readPlyValue(record + data->offsets[1], data->positionTypes[1]);
+			vertex.z = (float)readPlyValue(record + data->offsets[2], data->positionTypes[2]);
+		}
+	}
+}
+
+// read a block of faces, assuming every face is a triangle (so all face records are the same size)
+// any face that isn't a triangle is counted in badFaces, after which the faces have to be read again one after another
+static void readPlyTriangles(void* threadData, unsigned int block, unsigned int thread)
+{
+	PlyData* data = (PlyData*)threadData;
+	const unsigned int countSize = PLY_TYPE_SIZES[data->countType], indexSize = PLY_TYPE_SIZES[data->indexType];
+	const unsigned int stride = countSize + 3 * indexSize;
+	unsigned int first = block * MESH_BLOCK_ITEMS;
+	unsigned int last = std::min(first + MESH_BLOCK_ITEMS, data->mesh->numTriangles);
+
+	const unsigned char* record = data->faceData + (size_t)first * stride;
+	unsigned int* indices = &data->mesh->indices[(size_t)first * 3];
+	for (unsigned int i = first; i < last; ++i, record += stride, indices += 3)
+	{
+		if (readPlyInteger(record, data->countType) != 3)
+		{
+			InterlockedIncrement(&data->badFaces);
+			return;
+		}
+
+		for (int k = 0; k < 3; ++k)
+		{
+			long long index = readPlyInteger(record + countSize + k * indexSize, data->indexType);
+			if (index < 0 || index >= data->mesh->numVertices)
+			{
+				InterlockedIncrement(&data->badIndices);
+				index = 0;
+			}
+			indices[k] = (unsigned int)index;
+		}
+	}
+}
+
+// walk through the face records one after another, splitting faces into fans of triangles
+// counts the triangles if indices is NULL, returns false if the records run past the end of the file
+static bool walkPlyFaces(const PlyElement* element, const unsigned char* p, const unsigned char* end, unsigned int numVertices,
+	unsigned long long* numTriangles, unsigned int* indices, unsigned int* badIndices)
+{
+	*numTriangles = 0;
+
+	for (unsigned long long f = 0; f < element->count; ++f)
+	{
+		for (unsigned int j = 0; j < element->numProperties; ++j)
+		{
+			const PlyProperty* property = &element->properties[j];
+			const unsigned int size = PLY_TYPE_SIZES[property->type];
+
+			if (property->countType == PLY_NONE)
+			{
+				if ((size_t)(end - p) < size) return false;
+				p += size;
+				continue;
+			}
+
+			const unsigned int countSize = PLY_TYPE_SIZES[property->countType];
+			if ((size_t)(end - p) < countSize) return false;
+			long long count = readPlyInteger(p, property->countType);
+			p += countSize;
+			if (count < 0 || (unsigned long long)(end - p) < (unsigned long long)count * size) return false;
+
+			bool vertexList = strcmp(property->name, "vertex_indices") == 0 || strcmp(property->name, "vertex_index") == 0;
+			if (vertexList && count >= 3)
+			{
+				*numTriangles += count - 2;
+
+				if (indices != NULL)
+				{
+					long long first = readPlyInteger(p, property->type);
+					if (first < 0 || first >= numVertices) { (*badIndices)++; first = 0; }
+
+					long long previous = first;
+					for (long long k = 1; k < count; ++k)
+					{
+						long long index = readPlyInteger(p + k * size, property->type);
+						if (index < 0 || index >= numVertices) { (*badIndices)++; index = first; }
+
+						if (k >= 2)
+						{
+							indices[0] = (unsigned int)first;
+							indices[1] = (unsigned int)previous;
+							indices[2] = (unsigned int)index;
+							indices += 3;
+						}
+						previous = index;
+					}
+				}
+			}
+
+			p += count * size;
+		}
+	}
+
+	return true;
+}
+
+// read a PLY file's vertices and faces into a mesh
+static bool loadPly(const char* fileName, const char* file, size_t size, unsigned int threads, SceneArena* arena, Mesh* mesh)
+{
+	PlyElement elements[PLY_MAX_ELEMENTS];
+	unsigned int numElements;
+	const char* body = readPlyHeader(fileName, file, size, elements, &numElements);
+	if (body == NULL) return false;
+
+	const unsigned char* p = (const unsigned char*)body;
+	const unsigned char* end = (const unsigned char*)file + size;
+
+	PlyData data;
+	memset(&data, 0, sizeof(data));
+	data.mesh = mesh;
+
+	// find the vertex and face data (elements with fixed size records can be skipped over, other elements have to come after the faces)
+	const PlyElement* vertexElement = NULL;
+	const PlyElement* faceElement = NULL;
+	for (unsigned int i = 0; i < numElements && faceElement == NULL; ++i)
+	{
+		const PlyElement* element = &elements[i];
+		bool isFace = strcmp(element->name, "face") == 0;
+
+		unsigned int stride = 0;
+		for (unsigned int j = 0; j < element->numProperties; ++j)
+		{
+			if (element->properties[j].countType != PLY_NONE && !isFace)
+			{
+				fprintf(stderr, "Mesh file %s: PLY element %s has a list before the faces.\n", fileName, element->name);
+				return false;
+			}
+			stride += PLY_TYPE_SIZES[element->properties[j].type];
+		}
+
+		if (isFace)
+		{
+			if (vertexElement == NULL) break;
+			faceElement = element;
+			data.faceData = p;
+			continue;
+		}
+
+		if (element->count > (unsigned long long)(end - p) / std::max(stride, 1u))
+		{
+			fprintf(stderr, "Mesh file %s: PLY file is truncated.\n", fileName);
+			return false;
+		}
+
+		if (strcmp(element->name, "vertex") == 0)
+		{
+			const char* axes[3] = { "x", "y", "z" };
+			for (int k = 0; k < 3; ++k)
+			{
+				unsigned int offset = 0;
+				data.positionTypes[k] = PLY_NONE;
+				for (unsigned int j = 0; j < element->numProperties; ++j)
+				{
+					const PlyProperty* property = &element->properties[j];
+					if (strcmp(property->name, axes[k]) == 0 && property->type >= PLY_FLOAT32)
+					{
+						data.offsets[k] = offset;
+						data.positionTypes[k] = property->type;
+					}
+					offset += PLY_TYPE_SIZES[property->type];
+				}
+				if (data.positionTypes[k] == PLY_NONE) break;
+			}
+
+			vertexElement = element;
+			data.vertexData = p;
+			data.vertexStride = stride;
+		}
+
+		p += element->count * stride;
+	}
+
+	if (vertexElement == NULL || faceElement == NULL || data.positionTypes[0] == PLY_NONE || data.positionTypes[1] == PLY_NONE || data.positionTypes[2] == PLY_NONE)
+	{
+		fprintf(stderr, "Mesh file %s: PLY file needs float x, y, z vertex positions followed by faces.\n", fileName);
+		return false;
+	}
+
+	if (vertexElement->count > 0xFFFFFFFFull || faceElement->count > 0xFFFFFFFFull / 3)
+	{
+		fprintf(stderr, "Mesh file %s: too many vertices or triangles.\n", fileName);
+		return false;
+	}
+
+	mesh->numVertices = (unsigned int)vertexElement->count;
+	mesh->vertices = (Point*)allocateSceneArena(arena, (size_t)mesh->numVertices * sizeof(Point));
+	runJobs(readPlyVertices, &data, (mesh->numVertices + MESH_BLOCK_ITEMS - 1) / MESH_BLOCK_ITEMS, threads);
+
+	// faces holding nothing but a vertex list are read in parallel (if the file's size says they're all triangles)
+	// when the faces are the last element their records have to fill the rest of the file exactly, so files with other faces are
+	// nearly always sent straight to the slow path, rather than allocating the fast path's indices only to find they're no use
+	const PlyProperty* list = &faceElement->properties[0];
+	const unsigned long long triangleBytes = faceElement->count * (PLY_TYPE_SIZES[list->countType] + 3 * PLY_TYPE_SIZES[list->type]);
+	const bool lastElement = faceElement == &elements[numElements - 1];
+	unsigned int fastTriangles = 0;
+	if (faceElement->numProperties == 1 && list->countType != PLY_NONE && list->type < PLY_FLOAT32 &&
+		(lastElement ? (unsigned long long)(end - data.faceData) == triangleBytes : (unsigned long long)(end - data.faceData) >= triangleBytes))
+	{
+		data.countType = list->countType;
+		data.indexType = list->type;
+		mesh->numTriangles = (unsigned int)faceElement->count;
+		mesh->indices = (unsigned int*)allocateSceneArena(arena, (size_t)mesh->numTriangles * 3 * sizeof(unsigned int));
+		runJobs(readPlyTriangles, &data, (mesh->numTriangles + MESH_BLOCK_ITEMS - 1) / MESH_BLOCK_ITEMS, threads);
+
+		if (data.badFaces == 0)
+		{
+			if (data.badIndices > 0)
+			{
+				fprintf(stderr, "Mesh file %s: %u faces have vertex indices out of range.\n", fileName, data.badIndices);
+				return false;
+			}
+			return true;
+		}
+
+		// (the indices are kept for the slow path, if there's room for all its triangles)
+		fastTriangles = mesh->numTriangles;
+	}
+
+	// otherwise the faces are counted, then split into triangles, one after another
+	for (unsigned int j = 0; j < faceElement->numProperties; ++j)
+	{
+		if (faceElement->properties[j].countType != PLY_NONE && faceElement->properties[j].type >= PLY_FLOAT32)
+		{
+			fprintf(stderr, "Mesh file %s: PLY face lists have to be integers.\n", fileName);
+			return false;
+		}
+	}
+
+	unsigned long long numTriangles;
+	unsigned int badIndices = 0;
+	if (!walkPlyFaces(faceElement, data.faceData, end, mesh->numVertices, &numTriangles, NULL, &badIndices))
+	{
+		fprintf(stderr, "Mesh file %s: PLY file is truncated.\n", fileName);
+		return false;
+	}
+	if (numTriangles * 3 > 0xFFFFFFFFull)
+	{
+		fprintf(stderr, "Mesh file %s: too many vertices or triangles.\n", fileName);
+		return false;
+	}
+
+	mesh->numTriangles = (unsigned int)numTriangles;
+	if (mesh->numTriangles > fastTriangles)
+	{
+		if (mesh->indices != NULL) releaseSceneArena(arena, mesh->indices, (size_t)fastTriangles * 3 * sizeof(unsigned int));
+		mesh->indices = (unsigned int*)allocateSceneArena(arena, (size_t)mesh->numTriangles * 3 * sizeof(unsigned int));
+	}
+	walkPlyFaces(faceElement, data.faceData, end, mesh->numVertices, &numTriangles, mesh->indices, &badIndices);
+
+	if (badIndices > 0)
+	{
+		fprintf(stderr, "Mesh file %s: %u faces have vertex indices out of range.\n", fileName, badIndices);
+		return false;
+	}
+
+	return true;
+}
+
+
+// data shared by the threads moving a mesh into place
+struct MeshPlacement
+{
+	Mesh* mesh;
+	Vector offset;
+	float scale;
+};
+
+// scale and move a block of vertices into place
+static void placeMeshVertices(void* threadData, unsigned int block, unsigned int thread)
+{
+	const MeshPlacement* placement = (const MeshPlacement*)threadData;
+	Mesh* mesh = placement->mesh;
+	unsigned int first = block * MESH_BLOCK_ITEMS;
+	unsigned int last = std::min(first + MESH_BLOCK_ITEMS, mesh->numVertices);
+
+	for (unsigned int i = first; i < last; ++i)
+		mesh->vertices[i] = mesh->vertices[i] * placement->scale + placement->offset;
+}
+
+
+// largest the process's working set has been so far (including the pages of mapped files that have been read)
+static size_t getPeakWorkingSet()
+{
+	PROCESS_MEMORY_COUNTERS memory;
+	memory.cb = sizeof(memory);
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory))) return 0;
+
+	return memory.PeakWorkingSetSize;
+}
+
+
+// read a mesh from a Wavefront OBJ or binary (little endian) PLY file, chosen by the file's extension
+bool loadMeshFile(const char* fileName, const Vector& offset, float scale, unsigned int threads, SceneArena* arena, Mesh* mesh)
+{
+	Timer timer;
+	size_t startPeak = getPeakWorkingSet();
+
+	mesh->numVertices = 0;
+	mesh->numTriangles = 0;
+	mesh->vertices = NULL;
+	mesh->quantized = NULL;
+	mesh->indices = NULL;
+
+	bool obj = hasExtension(fileName, ".obj");
+	if (!obj && !hasExtension(fileName, ".ply"))
+	{
+		fprintf(stderr, "Mesh file %s: only .obj and .ply files can be read.\n", fileName);
+		return false;
+	}
+
+	unsigned long long size;
+	const char* file = mapFile(fileName, false, &size);
+	if (file == NULL)
+	{
+		fprintf(stderr, "Mesh file %s: couldn't be read.\n", fileName);
+		return false;
+	}
+
+	bool loaded = obj ? loadObj(fileName, file, (size_t)size, threads, arena, mesh) : loadPly(fileName, file, (size_t)size, threads, arena, mesh);
+	UnmapViewOfFile(file);
+	if (!loaded) return false;
+
+	MeshPlacement placement = { mesh, offset, scale };
+	runJobs(placeMeshVertices, &placement, (mesh->numVertices + MESH_BLOCK_ITEMS - 1) / MESH_BLOCK_ITEMS, threads);
+
+	// the peak working set counts the mapped file's pages as well as the mesh's arrays, it only rises if the load set a new peak
+	timer.end();
+	size_t peak = getPeakWorkingSet();
+	printf("Mesh %s: %u vertices, %u triangles, %.1fMB (from a %.1fMB file) in %ums, peak working set %.1fMB (%.1fMB higher)\n", fileName,
+		mesh->numVertices, mesh->numTriangles, getMeshBytes(mesh) / (1024.0 * 1024.0), size / (1024.0 * 1024.0), timer.getMilliseconds(),
+		peak / (1024.0 * 1024.0), (peak - startPeak) / (1024.0 * 1024.0));
+
+	return true;
+}
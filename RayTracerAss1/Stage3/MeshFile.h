@@ -0,0 +1,13 @@
+#ifndef __MESH_FILE_H
+#define __MESH_FILE_H
+
+#include "SceneObjects.h"
+#include "SceneArena.h"
+
+// read a mesh from a Wavefront OBJ or binary (little endian) PLY file, chosen by the file's extension
+// the file is memory mapped and parsed by the given number of threads, faces with more than three vertices are split into fans
+// the vertices are then moved into place (vertex * scale + offset), the mesh's arrays are allocated from the given arena
+// returns false (after printing why) if the file can't be read
+bool loadMeshFile(const char* fileName, const Vector& offset, float scale, unsigned int threads, SceneArena* arena, Mesh* mesh);
+
+#endif // __MESH_FILE_H
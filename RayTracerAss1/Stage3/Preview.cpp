@@ -0,0 +1,176 @@
+#include "Preview.h"
+
+// largest relative difference in depth between neighbours that can be filled in between
+const float PREVIEW_DEPTH_TOLERANCE = 0.05f;
+
+// smallest cosine of the angle between neighbouring normals that can be filled in between
+const float PREVIEW_NORMAL_TOLERANCE = 0.95f;
+
+// largest difference in a colour channel (after exposure, 0 to 1) between neighbours that can be filled in between
+// (catches shadow edges and reflections, which the hit data alone can't see)
+const float PREVIEW_CONTRAST_TOLERANCE = 0.1f;
+
+
+// allocate preview storage big enough for one tile
+void createPreviewBuffer(PreviewBuffer* preview, unsigned int blockSize)
+{
+	preview->pixelCapacity = blockSize * blockSize;
+	preview->colour = new Colour[preview->pixelCapacity];
+	preview->toneMapped = new Colour[preview->pixelCapacity];
+	preview->depth = new float[preview->pixelCapacity];
+	preview->normal = new Vector[preview->pixelCapacity];
+	preview->materialId = new int[preview->pixelCapacity];
+}
+
+
+// free preview storage
+void destroyPreviewBuffer(PreviewBuffer* preview)
+{
+	delete[] preview->colour;
+	delete[] preview->toneMapped;
+	delete[] preview->depth;
+	delete[] preview->normal;
+	delete[] preview->materialId;
+}
+
+
+// follow a pixel's primary ray (as traceRay does), keeping the depth, normal and material of its first hit
+static Colour tracePreviewRay(const Scene* scene, const RenderOptions* options, const Ray* viewRay, float* depth, Vector* normal, int* materialId)
+{
+	RayPath path;
+	startPath(&path, viewRay);
+
+	*depth = MAX_RAY_DISTANCE;
+	*normal = { 0.0f, 0.0f, 0.0f };
+	*materialId = -1;
+
+	if (!continuePath(options, &path)) return path.output;
+
+	Intersection intersect;
+	if (!objectIntersection(scene, &path.ray, &intersect))
+	{
+		endPathAtSkybox(scene, &path);
+		return path.output;
+	}
+
+	calculateIntersectionResponse(scene, &path.ray, &intersect);
+
+	*depth = (intersect.pos - path.ray.start) * path.ray.dir;
+	*normal = intersect.normal;
+	*materialId = (int)(intersect.material - scene->materialContainer);
+
+	if (!shadePath(scene, &path, &intersect)) return path.output;
+
+	path.level++;
+	return finishPath(scene, options, &path);
+}
+
+
+// render a single tile tracing only every second pixel across and down (one sample each), filling in the rest from their traced neighbours
+// pixels whose neighbours hit different materials, are at different depths, face different ways or contrast in colour are traced for real
+unsigned int renderTilePreview(const Scene* scene, const Camera* camera, const RenderOptions* options, const Tile* tile, int threadId, PreviewBuffer* preview)
+{
+	const int tileWidth = tile->endX - tile->startX, tileHeight = tile->endY - tile->startY;
+	const SamplePattern* pattern = &options->samplePattern;
+	unsigned int rays = 0;
+
+	// first pass: trace the even pixels (within the tile) of the even rows
+	for (int ty = 0; ty < tileHeight; ty += 2)
+	{
+		int y = tile->startY + ty - camera->centreY;
+
+		for (int tx = 0; tx < tileWidth; tx += 2)
+		{
+			int x = tile->startX + tx - camera->centreX;
+			unsigned int i = ty * tileWidth + tx;
+
+			const float* offsetX, * offsetY;
+			getPixelSamples(pattern, x, y, &offsetX, &offsetY);
+			Ray viewRay = getCameraRay(camera, x + offsetX[0], y + offsetY[0]);
+
+			preview->colour[i] = tracePreviewRay(scene, options, &viewRay, &preview->depth[i], &preview->normal[i], &preview->materialId[i]);
+			preview->toneMapped[i] = preview->colour[i].applyExposure(scene->exposure);
+			rays++;
+		}
+	}
+
+	// second pass: fill in the rest of the pixels from the traced pixels beside them (left and right, above and below, or diagonally)
+	// and write out the tile
+	for (int ty = 0; ty < tileHeight; ty++)
+	{
+		unsigned int* out = buffer + getImageIndex(options, tile->startX, tile->startY + ty);
+		int y = tile->startY + ty - camera->centreY;
+
+		for (int tx = 0; tx < tileWidth; tx++)
+		{
+			Colour output;
+
+			if (tx % 2 == 0 && ty % 2 == 0)
+			{
+				output = preview->colour[ty * tileWidth + tx];
+			}
+			else
+			{
+				// traced neighbours (those off the edge of the tile are skipped)
+				unsigned int neighbours[4], numNeighbours = 0;
+				for (int ny = ty - ty % 2; ny <= ty + ty % 2; ny += 2)
+				{
+					for (int nx = tx - tx % 2; nx <= tx + tx % 2; nx += 2)
+					{
+						if (nx < tileWidth && ny < tileHeight) neighbours[numNeighbours++] = ny * tileWidth + nx;
+					}
+				}
+
+				// the neighbours have to agree on what they hit (and roughly on their colour) for the pixel to be filled in
+				unsigned int first = neighbours[0];
+				bool consistent = true;
+				float minDepth = preview->depth[first], maxDepth = preview->depth[first];
+
+				for (unsigned int n = 1; n < numNeighbours && consistent; n++)
+				{
+					unsigned int i = neighbours[n];
+					consistent = preview->materialId[i] == preview->materialId[first]
+						&& (preview->materialId[i] < 0 || preview->normal[i] * preview->normal[first] >= PREVIEW_NORMAL_TOLERANCE)
+						&& fabsf(preview->toneMapped[i].red - preview->toneMapped[first].red) <= PREVIEW_CONTRAST_TOLERANCE
+						&& fabsf(preview->toneMapped[i].green - preview->toneMapped[first].green) <= PREVIEW_CONTRAST_TOLERANCE
+						&& fabsf(preview->toneMapped[i].blue - preview->toneMapped[first].blue) <= PREVIEW_CONTRAST_TOLERANCE;
+
+					minDepth = std::min(minDepth, preview->depth[i]);
+					maxDepth = std::max(maxDepth, preview->depth[i]);
+				}
+
+				if (consistent && maxDepth - minDepth <= PREVIEW_DEPTH_TOLERANCE * minDepth)
+				{
+					output = Colour(0.0f, 0.0f, 0.0f);
+					for (unsigned int n = 0; n < numNeighbours; n++)
+						output += (1.0f / numNeighbours) * preview->colour[neighbours[n]];
+				}
+				else
+				{
+					// silhouette or crease: trace the pixel
+					int x = tile->startX + tx - camera->centreX;
+					float depth;
+					Vector normal;
+					int materialId;
+
+					const float* offsetX, * offsetY;
+					getPixelSamples(pattern, x, y, &offsetX, &offsetY);
+					Ray viewRay = getCameraRay(camera, x + offsetX[0], y + offsetY[0]);
+
+					output = tracePreviewRay(scene, options, &viewRay, &depth, &normal, &materialId);
+					rays++;
+				}
+			}
+
+			//color rise processing
+			if (options->colourise) {
+				output.colourise(threadId % 7);
+			}
+
+			// store saturated final colour value in image buffer
+			*out++ = output.convertToPixel(scene->exposure);
+		}
+	}
+
+	return rays;
+}
@@ -0,0 +1,28 @@
+#ifndef __PREVIEW_H
+#define __PREVIEW_H
+
+#include "Render.h"
+
+// per tile working space for the half resolution preview
+typedef struct PreviewBuffer
+{
+	unsigned int pixelCapacity;		// maximum number of pixels in a tile
+	Colour* colour;					// colour of each traced pixel
+	Colour* toneMapped;				// colour of each traced pixel after exposure (what the contrast is measured on)
+	float* depth;					// distance to the primary hit of each traced pixel
+	Vector* normal;					// normal at the primary hit of each traced pixel
+	int* materialId;				// material of the primary hit of each traced pixel (-1 for a miss)
+} PreviewBuffer;
+
+// allocate preview storage big enough for one tile
+void createPreviewBuffer(PreviewBuffer* preview, unsigned int blockSize);
+
+// free preview storage
+void destroyPreviewBuffer(PreviewBuffer* preview);
+
+// render a single tile tracing only every second pixel across and down (one sample each), filling in the rest from their traced neighbours
+// pixels whose neighbours hit different materials, are at different depths, face different ways or contrast in colour are traced for real
+// returns the number of primary rays traced
+unsigned int renderTilePreview(const Scene* scene, const Camera* camera, const RenderOptions* options, const Tile* tile, int threadId, PreviewBuffer* preview);
+
+#endif // __PREVIEW_H
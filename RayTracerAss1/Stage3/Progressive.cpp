@@ -0,0 +1,195 @@
+#define NOMINMAX
+#include <windows.h>
+
+#include "Progressive.h"
+#include "TextureCache.h"
+#include "Jobs.h"
+
+// running totals for every pixel of the image
+typedef struct AccumulationBuffer
+{
+	Colour* sum;					// sum of the pixel's samples
+	float* brightnessSum;			// sum of the samples' brightness (after exposure)
+	float* brightnessSquaredSum;	// sum of the squares of the samples' brightness
+} AccumulationBuffer;
+
+
+// progress of a single tile
+typedef struct ProgressiveTile
+{
+	Tile tile;						// area of the image covered
+	unsigned int samples;			// samples taken by each of the tile's pixels so far
+	float variance;					// average variance of the tile's pixel colours (i.e. how uncertain they still are)
+} ProgressiveTile;
+
+
+// data passed to each progressive rendering thread
+struct ProgressiveThreadData
+{
+	const Scene* scene;
+	const Camera* camera;
+	const RenderOptions* options;
+	AccumulationBuffer* accumulation;
+	ProgressiveTile* tiles;
+	const unsigned int* jobs;		// tiles to take another sample for, in order
+	unsigned int deadline;			// tick count at which to stop taking new jobs
+	bool finishAllJobs;				// ignore the deadline (for the first pass)
+};
+
+
+// brightness of a colour after exposure
+static float getBrightness(const Colour& colour, float exposure)
+{
+	Colour exposed = colour.applyExposure(exposure);
+
+	return 0.2126f * exposed.red + 0.7152f * exposed.green + 0.0722f * exposed.blue;
+}
+
+
+// take the next sample for every pixel of a tile, and update the tile's variance
+static void renderTileSample(const Scene* scene, const Camera* camera, const RenderOptions* options, AccumulationBuffer* accumulation, ProgressiveTile* progress)
+{
+	const Tile* tile = &progress->tile;
+	const unsigned int sample = progress->samples, samples = sample + 1;
+
+	float varianceSum = 0.0f;
+
+	for (int py = tile->startY; py < tile->endY; py++)
+	{
+		int y = py - camera->centreY;
+
+		for (int px = tile->startX; px < tile->endX; px++)
+		{
+			int x = px - camera->centreX;
+			unsigned int pixel = getImageIndex(options, px, py);
+
+			const float* offsetX, * offsetY;
+			getPixelSamples(&options->samplePattern, x, y, &offsetX, &offsetY);
+
+			Colour colour = traceRay(scene, options, getCameraRay(camera, x + offsetX[sample], y + offsetY[sample]));
+			float brightness = getBrightness(colour, scene->exposure);
+
+			accumulation->sum[pixel] += colour;
+			accumulation->brightnessSum[pixel] += brightness;
+			accumulation->brightnessSquaredSum[pixel] += brightness * brightness;
+
+			// variance of the pixel's average (the sample variance divided by the number of samples)
+			float mean = accumulation->brightnessSum[pixel] / samples;
+			varianceSum += std::max(accumulation->brightnessSquaredSum[pixel] / samples - mean * mean, 0.0f) / samples;
+		}
+	}
+
+	progress->samples = samples;
+	progress->variance = varianceSum / ((tile->endX - tile->startX) * (tile->endY - tile->startY));
+}
+
+
+// take another sample for a job's tile, unless the deadline has passed
+static void renderProgressiveJob(void* threadData, unsigned int jobIndex, unsigned int thread)
+{
+	ProgressiveThreadData* data = (ProgressiveThreadData*)threadData;
+
+	if (!data->finishAllJobs && (int)(GetTickCount() - data->deadline) >= 0) return;
+
+	renderTileSample(data->scene, data->camera, data->options, data->accumulation, &data->tiles[data->jobs[jobIndex]]);
+}
+
+
+// add a thread's statistics to the totals once it runs out of jobs
+static void finishProgressiveThread(void* threadData, unsigned int thread)
+{
+	flushTextureCacheStats();
+	flushPathStats();
+}
+
+
+// render the image one sample per pixel at a time until the time budget (in milliseconds) runs out
+float renderProgressive(const Scene* scene, const Camera* camera, const RenderOptions* options, unsigned int threads, unsigned int timeBudget)
+{
+	const int numPixels = (options->crop.endX - options->crop.startX) * (options->crop.endY - options->crop.startY);
+	const unsigned int maxSamples = options->samplePattern.samplesPerPixel;
+	const unsigned int deadline = GetTickCount() + timeBudget;
+
+	AccumulationBuffer accumulation;
+	accumulation.sum = new Colour[numPixels];
+	accumulation.brightnessSum = new float[numPixels];
+	accumulation.brightnessSquaredSum = new float[numPixels];
+
+	for (int i = 0; i < numPixels; ++i)
+	{
+		accumulation.sum[i] = Colour(0.0f, 0.0f, 0.0f);
+		accumulation.brightnessSum[i] = 0.0f;
+		accumulation.brightnessSquaredSum[i] = 0.0f;
+	}
+
+	// count the tiles
+	unsigned int numTiles = 0;
+	Tile tile;
+	while (getTile(numTiles, &options->crop, options->blockSize, &tile)) numTiles++;
+
+	ProgressiveTile* tiles = new ProgressiveTile[numTiles];
+	unsigned int* jobs = new unsigned int[numTiles];
+
+	for (unsigned int i = 0; i < numTiles; ++i)
+	{
+		getTile(i, &options->crop, options->blockSize, &tiles[i].tile);
+		tiles[i].samples = 0;
+		tiles[i].variance = 0.0f;
+	}
+
+	for (unsigned int pass = 0;; ++pass)
+	{
+		// pick the tiles for this pass: every tile for the first two passes (there's no variance until there are two samples),
+		// then the half of the unfinished tiles with the highest variance, highest first
+		// (tiles whose samples have all been the same, e.g. flat areas of sky, are treated as finished)
+		unsigned int numJobs = 0;
+		for (unsigned int i = 0; i < numTiles; ++i)
+		{
+			if (tiles[i].samples >= maxSamples) continue;
+			if (tiles[i].samples >= 2 && tiles[i].variance <= 0.0f) continue;
+
+			jobs[numJobs++] = i;
+		}
+
+		if (numJobs == 0) break;
+
+		if (pass >= 2)
+		{
+			std::sort(jobs, jobs + numJobs, [tiles](unsigned int a, unsigned int b) { return tiles[a].variance > tiles[b].variance; });
+			numJobs = (numJobs + 1) / 2;
+		}
+
+		ProgressiveThreadData threadData = { scene, camera, options, &accumulation, tiles, jobs, deadline, pass == 0 };
+		runJobs(renderProgressiveJob, NULL, finishProgressiveThread, &threadData, numJobs, threads);
+
+		if ((int)(GetTickCount() - deadline) >= 0) break;
+	}
+
+	// write out the average of each pixel's samples
+	unsigned long long totalSamples = 0;
+
+	for (unsigned int i = 0; i < numTiles; ++i)
+	{
+		const Tile* area = &tiles[i].tile;
+		const float sampleRatio = 1.0f / tiles[i].samples;
+
+		for (int py = area->startY; py < area->endY; py++)
+		{
+			for (int px = area->startX; px < area->endX; px++)
+			{
+				unsigned int pixel = getImageIndex(options, px, py);
+				buffer[pixel] = (sampleRatio * accumulation.sum[pixel]).convertToPixel(scene->exposure);
+			}
+		}
+
+		totalSamples += (unsigned long long)tiles[i].samples * (area->endX - area->startX) * (area->endY - area->startY);
+	}
+
+	delete[] tiles;
+	delete[] jobs;
+	delete[] accumulation.sum;
+	delete[] accumulation.brightnessSum;
+	delete[] accumulation.brightnessSquaredSum;
+
+	return float(totalSamples) / numPixels;
+}
@@ -0,0 +1,13 @@
+#ifndef __PROGRESSIVE_H
+#define __PROGRESSIVE_H
+
+#include "Render.h"
+
+// render the image one sample per pixel at a time until the time budget (in milliseconds) runs out, then write the average of
+// each pixel's samples to the image buffer
+// the first pass always covers the whole image, after which passes go to the tiles with the highest variance first
+// each pixel takes at most options->samplePattern.samplesPerPixel samples, in the pattern's order
+// returns the average number of samples taken per pixel
+float renderProgressive(const Scene* scene, const Camera* camera, const RenderOptions* options, unsigned int threads, unsigned int timeBudget);
+
+#endif // __PROGRESSIVE_H
@@ -11,10 +11,33 @@ It is free to use for educational purpose and cannot be redistributed outside of
 #include "Lighting.h"
 #include "Intersection.h"
 #include "ImageIO.h"
+#include "ImageCompare.h"
+#include "Render.h"
+#include "Deferred.h"
+#include "Adaptive.h"
+#include "Wavefront.h"
+#include "Preview.h"
+#include "Filter.h"
+#include "Progressive.h"
+#include "ShadowMap.h"
+#include "TextureCache.h"
+#include "SceneCache.h"
+#include "Mesh.h"
+#include "Bvh.h"
+#include "SceneWatch.h"
+#include "SceneStats.h"
+#include "FastMath.h"
+#include "Jobs.h"
 #include <iostream> 
 
 unsigned int buffer[MAX_WIDTH * MAX_HEIGHT];
 
+// paths traced over all threads, by number of rays cast
+static volatile long long totalPathDepths[MAX_RAYS_CAST + 1];
+
+// paths traced by the current thread since its counts were last added to the totals
+static thread_local long long threadPathDepths[MAX_RAYS_CAST + 1];
+
 // reflect the ray from an object
 Ray calculateReflection(const Ray* viewRay, const Intersection* intersect)
 {
@@ -62,267 +85,508 @@ Ray calculateRefraction(const Ray* viewRay, const Intersection* intersect, float
 
 
 
-// follow a single ray until it's final destination (or maximum number of steps reached)
-Colour traceRay(const Scene* scene, Ray viewRay)
+// set up the path for the next ray after an intersection (reflection or refraction)
+// returns false if the material neither reflects nor refracts (i.e. the path ends here)
+bool bouncePath(RayPath* path, const Intersection* intersect)
 {
-	Colour output(0.0f, 0.0f, 0.0f); 								// colour value to be output
-	float currentRefractiveIndex = DEFAULT_REFRACTIVE_INDEX;		// current refractive index
-	float coef = 1.0f;												// amount of ray left to transmit
-	Intersection intersect;											// properties of current intersection
+	// if object has reflection or refraction component, adjust the view ray and coefficent of calculation and continue looping
+	if (intersect->material->reflection)
+	{
+		path->ray = calculateReflection(&path->ray, intersect);
+		path->coef *= intersect->material->reflection;
+	}
+	else if (intersect->material->refraction)
+	{
+		path->ray = calculateRefraction(&path->ray, intersect, &path->refractiveIndex);
+		path->coef *= intersect->material->refraction;
+	}
+	else
+	{
+		// if no reflection or refraction, then finish looping (cast no more rays)
+		return false;
+	}
 
-																	// loop until reached maximum ray cast limit (unless loop is broken out of)
-	for (int level = 0; level < MAX_RAYS_CAST; ++level)
+	return true;
+}
+
+
+// record the number of rays a finished path cast (for paths which end without finishPath)
+void recordPathDepth(int rays)
+{
+	threadPathDepths[rays]++;
+}
+
+
+// add the calling thread's path depth counts to the totals (call as each render thread finishes)
+void flushPathStats()
+{
+	for (int i = 0; i <= MAX_RAYS_CAST; ++i)
 	{
-		// check for intersections between the view ray and any of the objects in the scene
-		// exit the loop if no intersection found
-		if (!objectIntersection(scene, &viewRay, &intersect)) break;
+		InterlockedExchangeAdd64(&totalPathDepths[i], threadPathDepths[i]);
+		threadPathDepths[i] = 0;
+	}
+}
 
-		// calculate response to collision: ie. get normal at point of collision and material of object
-		calculateIntersectionResponse(scene, &viewRay, &intersect);
 
-		// apply the diffuse and specular lighting 
-		if (!intersect.insideObject) output += coef * applyLighting(scene, &viewRay, &intersect);
+// zero the path depth totals
+void resetPathStats()
+{
+	for (int i = 0; i <= MAX_RAYS_CAST; ++i)
+		totalPathDepths[i] = 0;
+}
 
-		// if object has reflection or refraction component, adjust the view ray and coefficent of calculation and continue looping
-		if (intersect.material->reflection)
-		{
-			viewRay = calculateReflection(&viewRay, &intersect);
-			coef *= intersect.material->reflection;
-		}
-		else if (intersect.material->refraction)
-		{
-			viewRay = calculateRefraction(&viewRay, &intersect, &currentRefractiveIndex);
-			coef *= intersect.material->refraction;
-		}
-		else
+
+// print how many paths cast each number of rays
+void reportPathStats()
+{
+	long long paths = 0, rays = 0;
+	for (int i = 1; i <= MAX_RAYS_CAST; ++i)
+	{
+		paths += totalPathDepths[i];
+		rays += totalPathDepths[i] * i;
+	}
+
+	printf("Path depths (rays cast per path, %lld paths, %.3f rays per path):\n", paths, paths > 0 ? double(rays) / paths : 0.0);
+
+	for (int i = 1; i <= MAX_RAYS_CAST; ++i)
+	{
+		printf("  %2d: %12lld (%6.3f%%)\n", i, totalPathDepths[i], paths > 0 ? 100.0 * totalPathDepths[i] / paths : 0.0);
+	}
+}
+
+
+// start a path with the given primary ray
+void startPath(RayPath* path, const Ray* viewRay)
+{
+	path->ray = *viewRay;
+	path->output = Colour(0.0f, 0.0f, 0.0f);
+	path->coef = 1.0f;
+	path->refractiveIndex = DEFAULT_REFRACTIVE_INDEX;
+	path->level = 0;
+
+	// seed Russian roulette from the ray's direction, so every sample gets the same random numbers whichever thread traces it
+	unsigned int seed = floatAsInt(viewRay->dir.x) * 73856093u ^ floatAsInt(viewRay->dir.y) * 19349663u ^ floatAsInt(viewRay->dir.z) * 83492791u;
+	path->random = seed != 0 ? seed : 1;
+}
+
+
+// next random number from a path's state (xorshift), as a float from 0 to 1 (excluding 1)
+static float getPathRandom(RayPath* path)
+{
+	path->random ^= path->random << 13;
+	path->random ^= path->random >> 17;
+	path->random ^= path->random << 5;
+
+	return (path->random >> 8) * (1.0f / 16777216.0f);
+}
+
+
+// checks made before each ray of a path is cast (contribution cutoff and Russian roulette)
+// returns false if the path has been ended
+bool continuePath(const RenderOptions* options, RayPath* path)
+{
+	// stop following paths once they can't make a difference to the image
+	if (path->coef < options->contributionCutoff)
+	{
+		recordPathDepth(path->level);
+		return false;
+	}
+
+	// Russian roulette: end weak paths at random, and strengthen the survivors to make up for the ones ended
+	if (path->coef < options->rouletteThreshold)
+	{
+		if (getPathRandom(path) * options->rouletteThreshold >= path->coef)
 		{
-			// if no reflection or refraction, then finish looping (cast no more rays)
-			return output;
+			recordPathDepth(path->level);
+			return false;
 		}
+
+		path->coef = options->rouletteThreshold;
 	}
 
+	return true;
+}
+
+
+// apply the lighting at the path's latest intersection and set up its next ray
+// returns false if the path ends here
+bool shadePath(const Scene* scene, RayPath* path, const Intersection* intersect)
+{
+	// apply the diffuse and specular lighting 
+	if (!intersect->insideObject) path->output += path->coef * applyLighting(scene, &path->ray, intersect);
+
+	// continue with the reflected or refracted ray, if there is one
+	if (!bouncePath(path, intersect))
+	{
+		recordPathDepth(path->level + 1);
+		return false;
+	}
+
+	return true;
+}
+
+
+// end a path whose last ray missed everything (or which has cast as many rays as it's allowed), by reading from the environment map
+void endPathAtSkybox(const Scene* scene, RayPath* path)
+{
+	recordPathDepth(std::min(path->level + 1, MAX_RAYS_CAST));
+
 	// if the calculation coefficient is non-zero, read from the environment map
-	if (coef > 0.0f)
+	if (path->coef > 0.0f)
 	{
 		Material& currentMaterial = scene->materialContainer[scene->skyboxMaterialId];
 
-		output += coef * currentMaterial.diffuse;
+		path->output += path->coef * currentMaterial.diffuse;
 	}
-
-	return output;
 }
 
 
-// render scene at given width and height and anti-aliasing level
-void render(Scene* scene, const int width, const int height, const int aaLevel, int threadsId, int threads, unsigned int blockSize, bool colourRise, unsigned int* lineCount)
+// follow a path until it's final destination (or maximum number of steps reached, or it's been cut off) and return its colour
+Colour finishPath(const Scene* scene, const RenderOptions* options, RayPath* path)
 {
-	// angle between each successive ray cast (per pixel, anti-aliasing uses a fraction of this)
-	const float dirStepSize = 1.0f / (0.5f * width / tanf(PIOVER180 * 0.5f * scene->cameraFieldOfView));
-
-	/*
-	Notification:
-	In times cal, part of data will be lose due to float to int. For the reason, times cal need extend width and height to regstell lost value
-	*/
+	Intersection intersect;											// properties of current intersection
 
-	//cal regstelling of height and width
-	int tmpW = 0;
-	if (width%blockSize != 0)
-		tmpW += blockSize;
+	// loop until reached maximum ray cast limit (unless loop is broken out of)
+	for (; path->level < MAX_RAYS_CAST; ++path->level)
+	{
+		if (!continuePath(options, path)) return path->output;
 
-	int tmpH = 0;
-	if (height % blockSize != 0)
-		tmpH += blockSize;
+		// check for intersections between the view ray and any of the objects in the scene
+		// exit the loop if no intersection found
+		if (!objectIntersection(scene, &path->ray, &intersect)) break;
 
-	//cal the number of blocks the thread need to process
-	float tmpTimes = (float)((width + tmpW) * (height + tmpH) / (blockSize * blockSize));
-	int times = (int)tmpTimes;
+		// calculate response to collision: ie. get normal at point of collision and material of object
+		calculateIntersectionResponse(scene, &path->ray, &intersect);
 
+		if (!shadePath(scene, path, &intersect)) return path->output;
+	}
 
-	// pointer to output buffer
-	unsigned int* out = buffer;
+	endPathAtSkybox(scene, path);
 
-	//define start and end point of height and width
-	int startWidth;
-	int endWidth;
-	int startHeight;
-	int endHeight;
+	return path->output;
+}
 
-	//flat - if current block cross height
-	bool overLap = false;
 
-	unsigned int ii;
-	//for (int i = 0; i < times; i++)
-	while ((ii = InterlockedIncrement(lineCount)) < times)
-	{
-		int i = ii;
+// follow a single ray until it's final destination (or maximum number of steps reached, or it's been cut off)
+Colour traceRay(const Scene* scene, const RenderOptions* options, Ray viewRay)
+{
+	RayPath path;
+	startPath(&path, &viewRay);
 
-		//rintf("%ld \n", times);
-		//printf("%ld \n", i);
+	return finishPath(scene, options, &path);
+}
 
-		int tmp = blockSize * i;
 
-		//start and end point of width
-		startWidth = tmp - width * (int)(tmp / width);
-		endWidth = startWidth + blockSize;
+// find the area of the image covered by a tile (tiles are numbered row by row across the area being rendered)
+// returns false if the tile number is past the end of the area
+bool getTile(unsigned int tileIndex, const Tile* area, unsigned int blockSize, Tile* tile)
+{
+	unsigned int tilesX = (area->endX - area->startX + blockSize - 1) / blockSize;
+	unsigned int tilesY = (area->endY - area->startY + blockSize - 1) / blockSize;
 
-		//printf("%ld : %ld \n", i, startWidth);
-		//printf("%ld \n", startWidth);
+	if (tileIndex >= tilesX * tilesY) return false;
 
-		//if current block cross line, set end width value and set cross line flag to true
-		if (endWidth > width) {
-			endWidth = width;
-			overLap = !overLap;
-		}
+	tile->startX = area->startX + (tileIndex % tilesX) * blockSize;
+	tile->startY = area->startY + (tileIndex / tilesX) * blockSize;
+	tile->endX = std::min(tile->startX + (int)blockSize, area->endX);
+	tile->endY = std::min(tile->startY + (int)blockSize, area->endY);
 
-		//cal start and end point of height
-		startHeight = tmp / width * blockSize;
-		endHeight = startHeight + blockSize;
-		if (endHeight > height)
-			endHeight = height;
+	return true;
+}
 
-		//if current thread cal more than it need, exit
-		if (endHeight * endWidth > width * height)
-			return;
 
-		//cal next start point on buffer
-		out = buffer + tmp - width * (int)(tmp / width) + blockSize * width * (int)(tmp / width);
+// render a row of a tile with one sample per pixel, generating the primary rays a batch at a time
+static void renderRowSingleSample(const Scene* scene, const Camera* camera, const RenderOptions* options, const Tile* tile, int py, int threadId)
+{
+	unsigned int* out = buffer + getImageIndex(options, tile->startX, py);
+	const int y = py - camera->centreY;
 
-		/*
-		Notification:
-		tmp - width * (int)(tmp / width) is used to get start point on y
+	float dirX[CAMERA_ROW_BATCH], dirY[CAMERA_ROW_BATCH], dirZ[CAMERA_ROW_BATCH];
 
-		The others used to cal the square with arleady been processed
-		blockSize * width * (int)(tmp / width)
-		*/
+	for (int x = tile->startX - camera->centreX; x < tile->endX - camera->centreX; x += CAMERA_ROW_BATCH)
+	{
+		getCameraRowDirections(camera, float(x), float(y), 1.0f, dirX, dirY, dirZ);
 
-		do {
-			// loop through all the pixels
-			for (int y = startHeight - height / 2; y < endHeight - height / 2; y++)
-			{
+		for (int i = 0; i < CAMERA_ROW_BATCH && x + i < tile->endX - camera->centreX; i++)
+		{
+			Ray viewRay = { camera->position, { dirX[i], dirY[i], dirZ[i] } };
+			Colour output = traceRay(scene, options, viewRay);
 
-				for (int x = startWidth - width / 2; x < endWidth - width / 2; x++)
-				{
-					Colour output(0.0f, 0.0f, 0.0f);
-
-					// calculate multiple samples for each pixel
-					const float sampleStep = 1.0f / aaLevel, sampleRatio = 1.0f / (aaLevel * aaLevel);
-
-					// loop through all sub-locations within the pixel
-					for (float fragmentx = float(x); fragmentx < x + 1.0f; fragmentx += sampleStep)
-					{
-						for (float fragmenty = float(y); fragmenty < y + 1.0f; fragmenty += sampleStep)
-						{
-							// direction of default forward facing ray
-							Vector dir = { fragmentx * dirStepSize, fragmenty * dirStepSize, 1.0f };
-
-							// rotated direction of ray
-							Vector rotatedDir = {
-								dir.x * cosf(scene->cameraRotation) - dir.z * sinf(scene->cameraRotation),
-								dir.y,
-								dir.x * sinf(scene->cameraRotation) + dir.z * cosf(scene->cameraRotation) };
-
-							// view ray starting from camera position and heading in rotated (normalised) direction
-							Ray viewRay = { scene->cameraPosition, normalise(rotatedDir) };
-
-							// follow ray and add proportional of the result to the final pixel colour
-							output += sampleRatio * traceRay(scene, viewRay);
-						}
-
-					}
-
-					//color rise processing
-					if (colourRise) {
-						output.colourise(threadsId % 7);
-					}
-
-					// store saturated final colour value in image buffer
-					*out++ = output.convertToPixel(scene->exposure);
-				}
-				out += width - (endWidth - startWidth);
+			//color rise processing
+			if (options->colourise) {
+				output.colourise(threadId % 7);
 			}
 
-			//detect if block cross height
-			if (overLap) {
-				//if cross line block is accessed, exit current loop
-				if (startWidth == 0)
-					break;
+			// store saturated final colour value in image buffer
+			*out++ = output.convertToPixel(scene->exposure);
+		}
+	}
+}
 
-				//height start point reset
-				startHeight += blockSize;
 
-				//if start height is higher than high value, exit
-				if (startHeight > height)
-					return;
+// render a single tile, tracing each pixel's samples one after another
+void renderTile(const Scene* scene, const Camera* camera, const RenderOptions* options, const Tile* tile, int threadId)
+{
+	const SamplePattern* pattern = &options->samplePattern;
+	const float sampleRatio = 1.0f / pattern->samplesPerPixel;
 
-				//height end point reset
-				endHeight = startHeight + blockSize;
+	// loop through all the pixels
+	for (int py = tile->startY; py < tile->endY; py++)
+	{
+		// with one sample at the corner of each pixel the rays can be generated a row at a time
+		if (pattern->type == SamplePattern::REGULAR && pattern->samplesPerPixel == 1)
+		{
+			renderRowSingleSample(scene, camera, options, tile, py, threadId);
+			continue;
+		}
 
-				//if end point bigger than height, set to height
-				if (endHeight > height)
-					endHeight = height;
+		// pointer to output buffer
+		unsigned int* out = buffer + getImageIndex(options, tile->startX, py);
+		int y = py - camera->centreY;
 
-				//set end point of width
-				endWidth = startWidth + blockSize - width;
-				//set start point of width
-				startWidth = 0;
+		for (int x = tile->startX - camera->centreX; x < tile->endX - camera->centreX; x++)
+		{
+			Colour output(0.0f, 0.0f, 0.0f);
 
-				//recal start point on buffer
-				out = buffer + startHeight * width;
+			// calculate multiple samples for each pixel
+			const float* offsetX, * offsetY;
+			getPixelSamples(pattern, x, y, &offsetX, &offsetY);
 
+			// loop through all sub-locations within the pixel
+			for (unsigned int s = 0; s < pattern->samplesPerPixel; s++)
+			{
+				// follow ray and add proportional of the result to the final pixel colour
+				output += sampleRatio * traceRay(scene, options, getCameraRay(camera, x + offsetX[s], y + offsetY[s]));
 			}
-		} while (overLap);
-		/*
-		Notification:
-		Logic in the loop:
-		if the thread need cross height line, need to seperated 2 stpes:
-		First: process current line, end point is width
-		Second: Height + block size and process width which cal by original end point - (width * processed height)
-		*/
 
+			//color rise processing
+			if (options->colourise) {
+				output.colourise(threadId % 7);
+			}
 
-		//reset cross block flag
-		overLap = false;
+			// store saturated final colour value in image buffer
+			*out++ = output.convertToPixel(scene->exposure);
+		}
 	}
 }
 
+
 //set up thread struct
 struct ThreadData
 {
-	unsigned int id;	//threadId
-	Scene scene;		//scene
-	int width;			//img width
-	int height;			//img height
-	int sample;			//samples
-	int threads;		//total thread number
-	unsigned int blockSize;	//blocksize
-	bool colorRise;		//color rise flag
-	unsigned int* lineCount;
+	// per thread storage for the preview, adaptive anti-aliasing, wide filters, wavefront tracing or the deferred shading passes
+	// (only one is used, main makes sure no more than one is asked for)
+	GBuffer gbuffer;
+	PreviewBuffer preview;
+	AdaptiveBuffer adaptive;
+	FilterBuffer filter;
+	WavefrontBuffer wavefront;
+
+	unsigned long long rays;		//primary rays traced with the preview or adaptive anti-aliasing
+};
+
+// shared by the threads rendering a frame
+struct RenderJob
+{
+	const Scene* scene;	//shared (read only) scene
+	const Camera* camera;			//shared camera for the frame
+	const RenderOptions* options;	//shared render options
+	ThreadData* threadData;			//one per thread
 };
 
-//initial process with current thread value
-DWORD __stdcall ThreadStart(LPVOID threadData)
+
+// set up a thread's storage before it renders its first tile
+static void startRenderThread(void* jobData, unsigned int threadId)
 {
-	// cast the pointer to void (i.e. an untyped pointer) into something we can use
-	ThreadData* data = (ThreadData*)threadData;
+	const RenderJob* job = (const RenderJob*)jobData;
+	const RenderOptions* options = job->options;
+	ThreadData* data = &job->threadData[threadId];
+
+	if (options->preview) createPreviewBuffer(&data->preview, options->blockSize);
+	else if (options->adaptive) createAdaptiveBuffer(&data->adaptive, options->blockSize);
+	else if (options->filter != RenderOptions::BOX) createFilterBuffer(&data->filter, options->blockSize, options->samplePattern.samplesPerPixel);
+	else if (options->wavefront) createWavefrontBuffer(&data->wavefront, options->blockSize, options->samplePattern.samplesPerPixel);
+	else if (options->deferred) createGBuffer(&data->gbuffer, job->scene, options->blockSize, options->samplePattern.samplesPerPixel);
+}
+
+
+// render one tile of the image
+static void renderTileJob(void* jobData, unsigned int tileIndex, unsigned int threadId)
+{
+	const RenderJob* job = (const RenderJob*)jobData;
+	const Scene* scene = job->scene;
+	const Camera* camera = job->camera;
+	const RenderOptions* options = job->options;
+	ThreadData* data = &job->threadData[threadId];
+
+	Tile tile;
+	getTile(tileIndex, &options->crop, options->blockSize, &tile);
+
+	if (options->preview)
+		data->rays += renderTilePreview(scene, camera, options, &tile, threadId, &data->preview);
+	else if (options->adaptive)
+		data->rays += renderTileAdaptive(scene, camera, options, &tile, threadId, &data->adaptive);
+	else if (options->filter != RenderOptions::BOX)
+		renderTileFiltered(scene, camera, options, &tile, threadId, &data->filter);
+	else if (options->wavefront)
+		renderTileWavefront(scene, camera, options, &tile, threadId, &data->wavefront);
+	else if (options->deferred)
+		renderTileDeferred(scene, camera, options, &tile, threadId, &data->gbuffer);
+	else
+		renderTile(scene, camera, options, &tile, threadId);
+}
+
+
+// free a thread's storage and add its statistics to the totals once the tiles run out
+static void finishRenderThread(void* jobData, unsigned int threadId)
+{
+	const RenderJob* job = (const RenderJob*)jobData;
+	const RenderOptions* options = job->options;
+	ThreadData* data = &job->threadData[threadId];
+
+	if (options->preview) destroyPreviewBuffer(&data->preview);
+	else if (options->adaptive) destroyAdaptiveBuffer(&data->adaptive);
+	else if (options->filter != RenderOptions::BOX) destroyFilterBuffer(&data->filter);
+	else if (options->wavefront) destroyWavefrontBuffer(&data->wavefront);
+	else if (options->deferred) destroyGBuffer(&data->gbuffer);
+
+	flushTextureCacheStats();
+	flushPathStats();
+}
+
+
+// render scene at given width and height and anti-aliasing level
+// tiles are handed out one at a time to the given number of threads until the image is finished
+// returns the number of primary rays traced by the preview or adaptive anti-aliasing (0 if neither is being used)
+static unsigned long long render(const Scene* scene, const Camera* camera, const RenderOptions* options, unsigned int threads, ThreadData* threadData)
+{
+	unsigned int numTiles = 0;
+	Tile tile;
+	while (getTile(numTiles, &options->crop, options->blockSize, &tile)) numTiles++;
+
+	// (some threads may not be used when there are fewer tiles than threads)
+	for (unsigned int i = 0; i < threads; i++) threadData[i].rays = 0;
+
+	RenderJob job = { scene, camera, options, threadData };
+	runJobs(renderTileJob, startRenderThread, finishRenderThread, &job, numTiles, threads);
+
+	unsigned long long rays = 0;
+	for (unsigned int i = 0; i < threads; i++) rays += threadData[i].rays;
+
+	return rays;
+}
+
+
+// read scene file (from its compiled cache when that's up to date, compiling it for next time otherwise)
+static bool readScene(const char* inputFilename, Scene* scene, bool sceneCache, unsigned int threads)
+{
+	if (sceneCache && loadSceneCache(inputFilename, scene)) return true;
+
+	if (!init(inputFilename, *scene, threads))
+	{
+		fprintf(stderr, "Failure when reading the Scene file.\n");
+		return false;
+	}
+
+	if (sceneCache && !saveSceneCache(inputFilename, scene))
+	{
+		fprintf(stderr, "Couldn't write the compiled scene cache for %s.\n", inputFilename);
+	}
+
+	return true;
+}
+
+
+// shrink the scene's geometry (the compiled cache always holds the scene as it was read)
+static void shrinkGeometry(Scene* scene, bool indexModels, bool quantizeMeshes)
+{
+	size_t originalBytes = getGeometryBytes(scene);
+
+	if (indexModels)
+		indexSceneTriangles(scene);
+
+	if (quantizeMeshes)
+	{
+		for (unsigned int m = 0; m < scene->numMeshes; ++m)
+			quantizeMesh(&scene->arena, &scene->meshContainer[m]);
+	}
+
+	printf("Geometry: %.2fMB in %u meshes (was %.2fMB)\n", getGeometryBytes(scene) / (1024.0 * 1024.0), scene->numMeshes, originalBytes / (1024.0 * 1024.0));
+}
+
+
+// build the hierarchy over the final geometry, or load it from its cache when the objects haven't changed since it was built
+// (the cache only depends on the objects' shapes, so new cameras, lights and materials still use it)
+static void prepareBvh(const char* inputFilename, Scene* scene, bool sceneCache)
+{
+	Timer timer;
+	bool cached = sceneCache && loadBvhCache(inputFilename, scene);
+	if (!cached)
+	{
+		buildBvh(scene);
+
+		if (sceneCache && !saveBvhCache(inputFilename, scene))
+		{
+			fprintf(stderr, "Couldn't write the BVH cache for %s.\n", inputFilename);
+		}
+	}
+	timer.end();
+
+	if (scene->bvh != NULL)
+	{
+		printf("BVH: %u nodes over %u objects, %s in %ums\n", scene->bvh->numNodes, scene->bvh->numObjects, cached ? "loaded" : "built", timer.getMilliseconds());
+	}
+}
 
-	render(&data->scene, data->width, data->height, data->sample, data->id, data->threads, data->blockSize, data->colorRise, data->lineCount);
 
-	ExitThread(NULL);
+// build the shadow maps up front (in parallel across lights)
+static void prepareShadowMaps(Scene* scene, unsigned int shadowMapSize, unsigned int threads)
+{
+	Timer timer;
+	buildShadowMaps(scene, shadowMapSize, threads);
+	timer.end();
+	printf("Shadow maps (%d lights at %ux%u): %ums\n", scene->numLights, shadowMapSize, shadowMapSize, timer.getMilliseconds());
 }
 
 
 // read command line arguments, render, and write out BMP file
 int main(int argc, char* argv[])
 {
-	int width = 1024;
-	int height = 1024;
-	int samples = 1;
-
 	// rendering options
+	RenderOptions options;
+	options.width = 1024;
+	options.height = 1024;
+	options.samples = 1;
+	options.blockSize = 64;
+	options.colourise = false;
+	options.deferred = false;
+	options.scalarTextures = false;
+	options.filter = RenderOptions::BOX;
+	options.preview = false;
+	options.adaptive = false;
+	options.adaptiveThreshold = 0.0f;
+	options.contributionCutoff = 0.0f;
+	options.rouletteThreshold = 0.0f;
+	options.wavefront = false;
+	options.sortRays = false;
+
 	int times = 1;
 	unsigned int threads = 1;
-	bool colourise = false;				
-	unsigned int blockSize = 64;		
+	bool shadowMaps = false;			// use approximate shadow maps instead of shadow rays
+	unsigned int shadowMapSize = 64;	// resolution of each shadow map cube face
+	const char* referenceFilename = NULL;	// image to compare the output against
+	SamplePattern::Type samplePattern = SamplePattern::REGULAR;	// positions of the anti-aliasing samples
+	bool pathStats = false;				// report the distribution of path depths
+	bool sceneCache = true;				// load (and save) the scene and its hierarchy from compiled caches next to the scene file
+	bool indexModels = false;			// weld the scene file's triangles into indexed meshes
+	bool quantizeMeshes = false;		// store mesh vertices as 16 bit steps across each mesh's bounds
+	bool largePages = false;			// back the scene's memory with large pages (when the user has the privilege)
+	bool bvh = true;					// only test rays against the objects in the boxes of a bounding volume hierarchy they pass through
+	bool crop = false;					// only render part of the image
+	bool watch = false;					// keep re-rendering the image each time the scene file is saved
+	bool stats = false;					// report what's in the scene and estimate the cost of rendering it
+	unsigned int timeBudget = 0;		// time (in ms) to spend refining the image progressively (0 to render every sample)
+	unsigned int textureCacheSize = 0;	// memory limit (in MB) for baked textures (0 to compute textures directly)
 
 	// default input / output filenames
 	const char* inputFilename = "../Scenes/bunny500.txt";
@@ -334,12 +598,12 @@ int main(int argc, char* argv[])
 	{
 		if (strcmp(argv[i], "-size") == 0)
 		{
-			width = atoi(argv[++i]);
-			height = atoi(argv[++i]);
+			options.width = atoi(argv[++i]);
+			options.height = atoi(argv[++i]);
 		}
 		else if (strcmp(argv[i], "-samples") == 0)
 		{
-			samples = atoi(argv[++i]);
+			options.samples = atoi(argv[++i]);
 		}
 		else if (strcmp(argv[i], "-input") == 0)
 		{
@@ -359,11 +623,122 @@ int main(int argc, char* argv[])
 		}
 		else if (strcmp(argv[i], "-colourise") == 0)
 		{
-			colourise = true;
+			options.colourise = true;
 		}
 		else if (strcmp(argv[i], "-blockSize") == 0)
 		{
-			blockSize = atoi(argv[++i]);
+			options.blockSize = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-deferred") == 0)
+		{
+			options.deferred = true;
+		}
+		else if (strcmp(argv[i], "-wavefront") == 0)
+		{
+			options.wavefront = true;
+		}
+		else if (strcmp(argv[i], "-sortRays") == 0)
+		{
+			options.wavefront = true;
+			options.sortRays = true;
+		}
+		else if (strcmp(argv[i], "-scalarTextures") == 0)
+		{
+			options.scalarTextures = true;
+		}
+		else if (strcmp(argv[i], "-preview") == 0)
+		{
+			options.preview = true;
+		}
+		else if (strcmp(argv[i], "-adaptive") == 0)
+		{
+			options.adaptive = true;
+			options.adaptiveThreshold = float(atof(argv[++i]));
+		}
+		else if (strcmp(argv[i], "-shadows") == 0)
+		{
+			shadowMaps = strcmp(argv[++i], "map") == 0;
+		}
+		else if (strcmp(argv[i], "-shadowMapSize") == 0)
+		{
+			shadowMapSize = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-sampler") == 0)
+		{
+			int type = getSamplePatternType(argv[++i]);
+			if (type >= 0)
+				samplePattern = (SamplePattern::Type)type;
+			else
+				fprintf(stderr, "unknown sample pattern: %s\n", argv[i]);
+		}
+		else if (strcmp(argv[i], "-filter") == 0)
+		{
+			int type = getFilterType(argv[++i]);
+			if (type >= 0)
+				options.filter = (RenderOptions::FilterType)type;
+			else
+				fprintf(stderr, "unknown filter: %s\n", argv[i]);
+		}
+		else if (strcmp(argv[i], "-cutoff") == 0)
+		{
+			options.contributionCutoff = float(atof(argv[++i]));
+		}
+		else if (strcmp(argv[i], "-roulette") == 0)
+		{
+			options.rouletteThreshold = float(atof(argv[++i]));
+		}
+		else if (strcmp(argv[i], "-noSceneCache") == 0)
+		{
+			sceneCache = false;
+		}
+		else if (strcmp(argv[i], "-indexModels") == 0)
+		{
+			indexModels = true;
+		}
+		else if (strcmp(argv[i], "-quantizeMeshes") == 0)
+		{
+			indexModels = true;
+			quantizeMeshes = true;
+		}
+		else if (strcmp(argv[i], "-noBvh") == 0)
+		{
+			bvh = false;
+		}
+		else if (strcmp(argv[i], "-largePages") == 0)
+		{
+			largePages = true;
+		}
+		else if (strcmp(argv[i], "-stats") == 0)
+		{
+			stats = true;
+		}
+		else if (strcmp(argv[i], "-watch") == 0)
+		{
+			watch = true;
+		}
+		else if (strcmp(argv[i], "-pathStats") == 0)
+		{
+			pathStats = true;
+		}
+		else if (strcmp(argv[i], "-crop") == 0)
+		{
+			crop = true;
+			options.crop.startX = atoi(argv[++i]);
+			options.crop.startY = atoi(argv[++i]);
+			options.crop.endX = atoi(argv[++i]);
+			options.crop.endY = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-timeBudget") == 0)
+		{
+			timeBudget = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-textureCache") == 0)
+		{
+			textureCacheSize = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-reference") == 0)
+		{
+			referenceFilename = argv[++i];
 		}
 		else
 		{
@@ -377,65 +752,251 @@ int main(int argc, char* argv[])
 		}
 	}
 
+	// each tile is drawn by a single renderer, so asking for more than one is an error rather than quietly picking one
+	if (options.preview + options.adaptive + (options.filter != RenderOptions::BOX) + options.wavefront + options.deferred > 1)
+	{
+		fprintf(stderr, "Only one of -preview, -adaptive, -filter tent|gaussian, -wavefront (or -sortRays) and -deferred can be used at a time.\n");
+		return -1;
+	}
+
+	// progressive rendering traces each sample the standard way, box filtered (so none of the tile renderers' options apply)
+	if (timeBudget > 0 && (options.preview || options.adaptive || options.wavefront || options.deferred || options.filter != RenderOptions::BOX || options.colourise))
+	{
+		fprintf(stderr, "-timeBudget can't be used with -preview, -adaptive, -wavefront, -sortRays, -deferred, -filter tent|gaussian or -colourise.\n");
+		return -1;
+	}
+
+	const int width = options.width, height = options.height;
+
+	// render the whole image unless cropped (crops are clipped to the image)
+	if (crop)
+	{
+		options.crop.startX = std::max(options.crop.startX, 0);
+		options.crop.startY = std::max(options.crop.startY, 0);
+		options.crop.endX = std::min(options.crop.endX, width);
+		options.crop.endY = std::min(options.crop.endY, height);
+
+		if (options.crop.startX >= options.crop.endX || options.crop.startY >= options.crop.endY)
+		{
+			fprintf(stderr, "Crop window is empty.\n");
+			return -1;
+		}
+	}
+	else
+	{
+		options.crop = { 0, width, 0, height };
+	}
+
+	const int outputWidth = options.crop.endX - options.crop.startX, outputHeight = options.crop.endY - options.crop.startY;
+
+	createSamplePattern(&options.samplePattern, samplePattern, options.samples);
+
 	// nasty (and fragile) kludge to make an ok-ish default output filename (can be overriden with "-output" command line option)
-	sprintf(outputFilenameBuffer, "../Outputs/Thread_%d_%s_%dx%dx%d_%s.bmp", threads, (strrchr(inputFilename, '/') + 1), width, height, samples, (strrchr(argv[0], '\\') + 1));
+	sprintf(outputFilenameBuffer, "../Outputs/Thread_%d_%s_%dx%dx%d_%s.bmp", threads, (strrchr(inputFilename, '/') + 1), width, height, options.samples, (strrchr(argv[0], '\\') + 1));
 
-	// read scene file
 	Scene scene;
-	if (!init(inputFilename, scene))
+	createSceneArena(&scene.arena, largePages);
+	if (!readScene(inputFilename, &scene, sceneCache, threads))
 	{
-		fprintf(stderr, "Failure when reading the Scene file.\n");
 		return -1;
 	}
 
+	if (indexModels || quantizeMeshes)
+	{
+		shrinkGeometry(&scene, indexModels, quantizeMeshes);
+	}
 
+	if (bvh)
+	{
+		prepareBvh(inputFilename, &scene, sceneCache);
+	}
 
-		HANDLE* threadHandles = new HANDLE[threads];
-		ThreadData* threadData = new ThreadData[threads];
+	if (shadowMaps)
+	{
+		prepareShadowMaps(&scene, shadowMapSize, threads);
+	}
 
-		// shared count of last line allocated to a thread (starts at -1 because we are using InterlockedIncrement)
-		unsigned int lineCount = -1;
+	// set up the baked texture caches (these are filled in as the image is rendered)
+	if (textureCacheSize > 0)
+	{
+		createTextureCaches(&scene, (size_t)textureCacheSize * 1024 * 1024);
+	}
 
-		//initial value in each threads
-		for (int i = 0; i < threads; i++) {
-			threadData[i].id = i;					//thread Id
-			threadData[i].width = width;			//img width
-			threadData[i].height = height;			//img height
-			threadData[i].scene = scene;			//img scene
-			threadData[i].sample = samples;			//img samples
-			threadData[i].threads = threads;		//total thread number
-			threadData[i].blockSize = blockSize;	//block size
-			threadData[i].colorRise = colourise;	//Colour rise
-			threadData[i].lineCount = &lineCount;
+	// report what the scene holds, and what rendering it is likely to cost
+	if (stats)
+	{
+		reportSceneStats(inputFilename, &scene);
+		reportRenderEstimate(&scene, &options, threads);
 
-			threadHandles[i] = CreateThread(NULL, 0, ThreadStart, (void*)&threadData[i], 0, NULL);
+		// (the estimate bakes texture bricks, which the render mustn't find already waiting)
+		if (textureCacheSize > 0)
+		{
+			resetTextureCaches(&scene);
 		}
+	}
+
+	// remember the scene file's sections, so edits to it can be found
+	SceneWatch sceneWatch;
+	if (watch && !startSceneWatch(inputFilename, &sceneWatch))
+	{
+		fprintf(stderr, "Failure when reading the Scene file.\n");
+		return -1;
+	}
+
+	ThreadData* threadData = new ThreadData[threads];
 
+	// render the scene (again after each edit, when watching the scene file)
+	for (;;)
+	{
 		// total time taken to render all runs (used to calculate average)
 		int totalTime = 0;
 
-		//Keep runing from 0 to 7 (Thread number 1 to 8)
-		for (int i = 0; i < times; i++)
+		// primary rays traced in the last run (when using the preview or adaptive anti-aliasing)
+		unsigned long long primaryRays = 0;
+
+		// average samples per pixel taken in the last run (when rendering progressively)
+		float progressiveSamples = 0.0f;
+
+		for (int run = 0; run < times; run++)
 		{
+			// every run bakes the texture bricks it needs from scratch (rather than later runs finding them already baked)
+			if (textureCacheSize > 0)
+			{
+				resetTextureCaches(&scene);
+			}
+
+			// and the path depths are those of the last run (as with the primary ray counts)
+			if (pathStats)
+			{
+				resetPathStats();
+			}
 
 			Timer timer;									// create timer
 
-			for (unsigned int i = 0; i < threads; i++)
-				WaitForSingleObject(threadHandles[i], INFINITE);
+			// camera basis for this frame
+			Camera camera;
+			createCamera(&camera, &scene, width, height);
+
+			// progressive rendering manages its own threads
+			if (timeBudget > 0)
+			{
+				progressiveSamples = renderProgressive(&scene, &camera, &options, threads, timeBudget);
+
+				timer.end();
+				totalTime += timer.getMilliseconds();
+				continue;
+			}
 
+			primaryRays = render(&scene, &camera, &options, threads, threadData);
 
 			timer.end();									// record end time
 			totalTime += timer.getMilliseconds();			// record total time taken
 		}
 
-
-		delete[] threadHandles;
-		delete[] threadData;
-
 		// output timing information (times run and average)
 		printf("Thread: %d_average time taken (%d run(s)): %ums\n", threads, times, totalTime / times);
 
+		if (timeBudget > 0)
+		{
+			printf("Progressive: %.2f samples per pixel on average (of %u)\n", progressiveSamples, options.samplePattern.samplesPerPixel);
+		}
+
+		if (options.preview)
+		{
+			unsigned long long fullRays = (unsigned long long)outputWidth * outputHeight;
+			printf("Preview: %llu primary rays (%.1f%% of %llu)\n", primaryRays, 100.0 * primaryRays / fullRays, fullRays);
+		}
+		else if (options.adaptive)
+		{
+			unsigned long long fullRays = (unsigned long long)outputWidth * outputHeight * options.samplePattern.samplesPerPixel;
+			printf("Adaptive anti-aliasing: %llu primary rays (%.1f%% of %llu)\n", primaryRays, 100.0 * primaryRays / fullRays, fullRays);
+		}
+
+		if (pathStats)
+		{
+			reportPathStats();
+		}
+
+		if (textureCacheSize > 0)
+		{
+			reportTextureCaches(&scene);
+		}
+
 		// output BMP file
-		write_bmp(outputFilename, buffer, width, height, width);
+		write_bmp(outputFilename, buffer, outputWidth, outputHeight, outputWidth);
+
+		// report the difference from a reference image (e.g. one rendered with exact shadows)
+		if (referenceFilename != NULL)
+		{
+			compare_bmp(referenceFilename, buffer, outputWidth, outputHeight, outputWidth);
+		}
+
+		if (!watch) break;
+
+		// wait for the scene file to be saved, then bring the scene up to date by re-reading only the sections that changed
+		// (everything is read again only when a model, or the number of objects, changes)
+		Timer timer;
+		SceneChanges changes;
+		for (;;)
+		{
+			printf("Watching %s for changes...\n", inputFilename);
+			fflush(stdout);
+			waitForSceneEdit(&sceneWatch);
+			timer.start();
+
+			if (!updateScene(&sceneWatch, &scene, &changes))
+			{
+				fprintf(stderr, "Failure when reading the Scene file, keeping the previous scene.\n");
+				continue;
+			}
+
+			// (a scene that can't be read leaves nothing behind, so the next edit reads everything again)
+			if (changes.models)
+			{
+				destroyScene(&scene);
+				if (readScene(inputFilename, &scene, sceneCache, threads)) break;
+			}
+			else if (changes.settings || changes.materials || changes.spheres || changes.lights)
+			{
+				break;
+			}
+		}
+
+		if (changes.models && (indexModels || quantizeMeshes))
+		{
+			shrinkGeometry(&scene, indexModels, quantizeMeshes);
+		}
+
+		// the hierarchy only depends on the objects' shapes, the shadow maps on them and the lights, and the texture caches on the materials and where they're used
+		if (bvh && (changes.models || changes.spheres))
+		{
+			prepareBvh(inputFilename, &scene, sceneCache);
+		}
+
+		if (shadowMaps && (changes.models || changes.spheres || changes.lights))
+		{
+			prepareShadowMaps(&scene, shadowMapSize, threads);
+		}
+
+		if (textureCacheSize > 0 && (changes.models || changes.spheres || changes.materials))
+		{
+			createTextureCaches(&scene, (size_t)textureCacheSize * 1024 * 1024);
+		}
+
+		timer.end();
+		printf("Scene updated in %ums:%s%s%s%s%s\n", timer.getMilliseconds(), changes.models ? " read again" : "", changes.settings ? " settings" : "",
+			changes.materials ? " materials" : "", changes.spheres ? " spheres" : "", changes.lights ? " lights" : "");
+	}
+
+	delete[] threadData;
+
+	if (watch)
+	{
+		stopSceneWatch(&sceneWatch);
+	}
+
+	destroyScene(&scene);
+	destroySamplePattern(&options.samplePattern);
 
+	return 0;
 }
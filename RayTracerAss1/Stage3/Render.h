@@ -0,0 +1,102 @@
+#ifndef __RENDER_H
+#define __RENDER_H
+
+#include "Scene.h"
+#include "Colour.h"
+#include "Intersection.h"
+#include "Camera.h"
+#include "Sampler.h"
+
+// output image buffer
+extern unsigned int buffer[MAX_WIDTH * MAX_HEIGHT];
+
+// rectangular area of the image rendered as a single unit of work (end values are exclusive)
+typedef struct Tile
+{
+	int startX, endX;
+	int startY, endY;
+} Tile;
+
+
+// options shared by all the render threads
+typedef struct RenderOptions
+{
+	int width;					// image width
+	int height;					// image height
+	Tile crop;					// area of the image to render (the whole image unless cropped), ray directions are still those of the full image
+	int samples;				// anti-aliasing level (samples along each axis of a pixel)
+	SamplePattern samplePattern;	// positions of the samples within each pixel
+	enum FilterType { BOX, TENT, GAUSSIAN } filter;	// how samples are combined into pixels (box only uses a pixel's own samples)
+	unsigned int blockSize;		// width and height of the square tiles handed out to threads
+	bool colourise;				// tint each tile with the colour of the thread that rendered it
+	bool deferred;				// shade primary hits in a separate pass over each tile
+	bool scalarTextures;		// texture deferred hits one at a time with the reference (non-batched) functions
+	bool preview;				// trace a quarter of the pixels and fill in the rest where they agree (one sample per pixel)
+	bool adaptive;				// only anti-alias pixels that contrast with their neighbours
+	float adaptiveThreshold;	// contrast (difference in a colour channel after exposure, 0 to 1) needed to anti-alias a pixel
+	float contributionCutoff;	// paths whose coefficient falls below this are ended (0 to follow paths to MAX_RAYS_CAST)
+	float rouletteThreshold;	// paths whose coefficient falls below this play Russian roulette (0 for no Russian roulette)
+	bool wavefront;				// trace each tile's paths a bounce at a time, in batches
+	bool sortRays;				// sort each bounce's rays by direction and origin before tracing them (wavefront only)
+} RenderOptions;
+
+
+// progress of a single ray path through the scene, so tracing can be continued from any bounce
+typedef struct RayPath
+{
+	Ray ray;					// current ray
+	Colour output;				// colour accumulated so far
+	float coef;					// amount of ray left to transmit
+	float refractiveIndex;		// current refractive index
+	int level;					// number of rays cast so far
+	unsigned int random;		// random number state for Russian roulette
+} RayPath;
+
+
+// find the area of the image covered by a tile (tiles are numbered row by row across the area being rendered)
+// returns false if the tile number is past the end of the area
+bool getTile(unsigned int tileIndex, const Tile* area, unsigned int blockSize, Tile* tile);
+
+// position in the output image buffer of a pixel of the full image (the buffer only holds the area being rendered)
+inline unsigned int getImageIndex(const RenderOptions* options, int x, int y)
+{
+	return (y - options->crop.startY) * (options->crop.endX - options->crop.startX) + (x - options->crop.startX);
+}
+
+// start a path with the given primary ray
+void startPath(RayPath* path, const Ray* viewRay);
+
+// set up the path for the next ray after an intersection (reflection or refraction)
+// returns false if the material neither reflects nor refracts (i.e. the path ends here)
+bool bouncePath(RayPath* path, const Intersection* intersect);
+
+// checks made before each ray of a path is cast (contribution cutoff and Russian roulette)
+// returns false if the path has been ended
+bool continuePath(const RenderOptions* options, RayPath* path);
+
+// apply the lighting at the path's latest intersection and set up its next ray
+// returns false if the path ends here
+bool shadePath(const Scene* scene, RayPath* path, const Intersection* intersect);
+
+// end a path whose last ray missed everything (or which has cast as many rays as it's allowed), by reading from the environment map
+void endPathAtSkybox(const Scene* scene, RayPath* path);
+
+// follow a path until it's final destination (or maximum number of steps reached, or it's been cut off) and return its colour
+Colour finishPath(const Scene* scene, const RenderOptions* options, RayPath* path);
+
+// follow a single ray until it's final destination (or maximum number of steps reached, or it's been cut off)
+Colour traceRay(const Scene* scene, const RenderOptions* options, Ray viewRay);
+
+// record the number of rays a finished path cast (for paths which end without finishPath)
+void recordPathDepth(int rays);
+
+// add the calling thread's path depth counts to the totals (call as each render thread finishes)
+void flushPathStats();
+
+// zero the path depth totals (call before each run, so they only count the paths of the run being reported)
+void resetPathStats();
+
+// print how many paths cast each number of rays
+void reportPathStats();
+
+#endif // __RENDER_H
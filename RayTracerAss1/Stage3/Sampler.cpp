@@ -0,0 +1,161 @@
+#include <string.h>
+#include <algorithm>
+
+#include "Sampler.h"
+
+// random number generator state for building the tables (fixed seed, so images are repeatable)
+static unsigned int randomState;
+
+
+// next random number (xorshift)
+static unsigned int randomBits()
+{
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return randomState;
+}
+
+
+// convert 32 random bits to a float from 0 to 1 (excluding 1)
+static float bitsToFloat(unsigned int bits)
+{
+	return (bits >> 8) * (1.0f / 16777216.0f);
+}
+
+
+// reverse the bits of a number (the base 2 radical inverse, as bits)
+static unsigned int reverseBits(unsigned int bits)
+{
+	bits = (bits << 16) | (bits >> 16);
+	bits = ((bits & 0x00ff00ff) << 8) | ((bits & 0xff00ff00) >> 8);
+	bits = ((bits & 0x0f0f0f0f) << 4) | ((bits & 0xf0f0f0f0) >> 4);
+	bits = ((bits & 0x33333333) << 2) | ((bits & 0xcccccccc) >> 2);
+	bits = ((bits & 0x55555555) << 1) | ((bits & 0xaaaaaaaa) >> 1);
+	return bits;
+}
+
+
+// second dimension of the Sobol sequence, as bits (xor'd with a scramble)
+static unsigned int sobolBits(unsigned int index, unsigned int scramble)
+{
+	for (unsigned int v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+	{
+		if (index & 1) scramble ^= v;
+	}
+
+	return scramble;
+}
+
+
+// radical inverse of a number in base 3
+static float radicalInverse3(unsigned int index)
+{
+	float result = 0.0f, digitValue = 1.0f / 3.0f;
+
+	for (; index != 0; index /= 3, digitValue /= 3.0f)
+	{
+		result += (index % 3) * digitValue;
+	}
+
+	return result;
+}
+
+
+// keep a shifted offset inside the pixel
+static float wrapOffset(float offset)
+{
+	offset = offset >= 1.0f ? offset - 1.0f : offset;
+	return offset < 1.0f ? offset : 0.0f;
+}
+
+
+// build the table of offsets for a sample pattern
+void createSamplePattern(SamplePattern* pattern, SamplePattern::Type type, int aaLevel)
+{
+	const unsigned int count = aaLevel * aaLevel;
+
+	pattern->type = type;
+	pattern->aaLevel = aaLevel;
+	pattern->samplesPerPixel = count;
+	pattern->tableSize = pattern->type == SamplePattern::REGULAR ? 1 : SAMPLE_TABLE_SIZE;
+	pattern->offsetX = new float[pattern->tableSize * count];
+	pattern->offsetY = new float[pattern->tableSize * count];
+
+	randomState = 0x9e3779b9;
+
+	for (unsigned int set = 0; set < pattern->tableSize; ++set)
+	{
+		float* offsetX = pattern->offsetX + set * count;
+		float* offsetY = pattern->offsetY + set * count;
+
+		// per set randomisation of the sequences
+		unsigned int scrambleX = randomBits(), scrambleY = randomBits();
+		float shiftX = bitsToFloat(scrambleX), shiftY = bitsToFloat(scrambleY);
+
+		for (unsigned int s = 0; s < count; ++s)
+		{
+			// grid cell of the sample (columns first, the order the renderer has always taken its samples in)
+			int i = s / aaLevel, j = s % aaLevel;
+
+			switch (pattern->type)
+			{
+			case SamplePattern::REGULAR:
+				offsetX[s] = float(i) / aaLevel;
+				offsetY[s] = float(j) / aaLevel;
+				break;
+			case SamplePattern::JITTERED:
+				offsetX[s] = (i + bitsToFloat(randomBits())) / aaLevel;
+				offsetY[s] = (j + bitsToFloat(randomBits())) / aaLevel;
+				break;
+			case SamplePattern::HALTON:
+				offsetX[s] = wrapOffset(bitsToFloat(reverseBits(s)) + shiftX);
+				offsetY[s] = wrapOffset(radicalInverse3(s) + shiftY);
+				break;
+			case SamplePattern::SOBOL:
+				offsetX[s] = bitsToFloat(reverseBits(s) ^ scrambleX);
+				offsetY[s] = bitsToFloat(sobolBits(s, scrambleY));
+				break;
+			}
+
+			// jittered offsets can round up to the edge of their cell (keep them inside the pixel)
+			offsetX[s] = std::min(offsetX[s], 0.99999994f);
+			offsetY[s] = std::min(offsetY[s], 0.99999994f);
+		}
+	}
+}
+
+
+// free a sample pattern's table
+void destroySamplePattern(SamplePattern* pattern)
+{
+	delete[] pattern->offsetX;
+	delete[] pattern->offsetY;
+}
+
+
+// offsets of the samples for the given pixel (samplesPerPixel of each)
+void getPixelSamples(const SamplePattern* pattern, int x, int y, const float** offsetX, const float** offsetY)
+{
+	// hash the pixel position to pick a set (neighbouring pixels get different sets, so patterns don't repeat visibly)
+	unsigned int hash = ((unsigned int)x * 73856093u) ^ ((unsigned int)y * 19349663u);
+	hash ^= hash >> 13;
+	hash *= 0x5bd1e995u;
+	hash ^= hash >> 15;
+
+	unsigned int set = hash & (pattern->tableSize - 1);
+
+	*offsetX = pattern->offsetX + set * pattern->samplesPerPixel;
+	*offsetY = pattern->offsetY + set * pattern->samplesPerPixel;
+}
+
+
+// pattern type for a name given on the command line (returns -1 if the name isn't known)
+int getSamplePatternType(const char* name)
+{
+	if (strcmp(name, "regular") == 0) return SamplePattern::REGULAR;
+	if (strcmp(name, "jittered") == 0) return SamplePattern::JITTERED;
+	if (strcmp(name, "halton") == 0) return SamplePattern::HALTON;
+	if (strcmp(name, "sobol") == 0) return SamplePattern::SOBOL;
+	return -1;
+}
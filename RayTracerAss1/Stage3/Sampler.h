@@ -0,0 +1,36 @@
+#ifndef __SAMPLER_H
+#define __SAMPLER_H
+
+// number of different sets of sample offsets in a pattern's table (a power of two; pixels pick one by hashing their position)
+const unsigned int SAMPLE_TABLE_SIZE = 64;
+
+// positions of the anti-aliasing samples within a pixel, precomputed as a table of offsets
+// every pixel gets exactly samplesPerPixel samples, and always the same ones for the same pixel
+typedef struct SamplePattern
+{
+	enum Type { REGULAR, JITTERED, HALTON, SOBOL } type;
+
+	int aaLevel;					// samples along each axis of a pixel
+	unsigned int samplesPerPixel;	// aaLevel squared
+	unsigned int tableSize;			// sets of offsets in the table (1 for the regular grid)
+	float* offsetX;					// offsets from the pixel's corner (0 to 1), samplesPerPixel per set
+	float* offsetY;
+} SamplePattern;
+
+// build the table of offsets for a sample pattern
+// regular:  grid of aaLevel x aaLevel samples starting at the pixel's corner (as the renderer has always used)
+// jittered: one randomly placed sample in each cell of the grid
+// halton:   points from the base 2 and 3 Halton sequence, randomly shifted (with wrap around) for each set
+// sobol:    points from the two dimensional Sobol (0,2)-sequence, randomly scrambled for each set
+void createSamplePattern(SamplePattern* pattern, SamplePattern::Type type, int aaLevel);
+
+// free a sample pattern's table
+void destroySamplePattern(SamplePattern* pattern);
+
+// offsets of the samples for the given pixel (samplesPerPixel of each)
+void getPixelSamples(const SamplePattern* pattern, int x, int y, const float** offsetX, const float** offsetY);
+
+// pattern type for a name given on the command line (returns -1 if the name isn't known)
+int getSamplePatternType(const char* name);
+
+#endif // __SAMPLER_H
@@ -4,35 +4,60 @@
 
 // YOU SHOULD _NOT_ NEED TO MODIFY THIS FILE (FOR ASSIGNMENT 1)
 
+#define NOMINMAX
+#include <windows.h>
 #include <iostream>
 #include <cmath>
+#include <vector>
 
 #include "Scene.h"
 #include "Config.h"
 #include "SceneObjects.h"
 
 #include "ImageIO.h"
+#include "MeshFile.h"
+#include "Mesh.h"
+#include "Jobs.h"
+#include "Lighting.h"
+#include "Bvh.h"
+#include "SceneCache.h"
+#include "ShadowMap.h"
+#include "TextureCache.h"
 
 #define SCENE_VERSION_MAJOR 1
 #define SCENE_VERSION_MINOR 5
 
 static const Vector NullVector = { 0.0f,0.0f,0.0f };
 static const Point Origin = { 0.0f,0.0f,0.0f };
-static const SimpleString emptyString("");
+
+// most triangles parsed as a single unit of work (large models are split into chunks of this size)
+const unsigned int MODEL_CHUNK_TRIANGLES = 1024;
+
+// a run of triangles from one model, with where they go in the triangle container
+struct ModelChunk
+{
+	int section;				// model's section in the scene file
+	Vector offset;				// model's position
+	float scale;				// model's size
+	int materialId;				// model's material
+	unsigned int first;			// number (within the model) of the first triangle
+	unsigned int count;			// number of triangles
+	Triangle* output;			// where the first triangle goes
+};
 
 bool GetMaterial(const Config &sceneFile, Material &currentMat)
 {
-    SimpleString materialType = sceneFile.GetByNameAsString("Type", emptyString);
+    const char* materialType = sceneFile.GetByNameAsString("Type", "");
 
-	if (materialType.compare("checkerboard") == 0)
+	if (strcmp(materialType, "checkerboard") == 0)
 	{
         currentMat.type = Material::CHECKERBOARD;
 	} 
-	else if (materialType.compare("wood") == 0)
+	else if (strcmp(materialType, "wood") == 0)
     {
         currentMat.type = Material::WOOD;
 	}
-	else if (materialType.compare("circles") == 0)
+	else if (strcmp(materialType, "circles") == 0)
 	{
 		currentMat.type = Material::CIRCLES;
 	}
@@ -52,25 +77,87 @@ bool GetMaterial(const Config &sceneFile, Material &currentMat)
 	currentMat.specular = sceneFile.GetByNameAsFloatOrColour("Specular", 0.0f);
 	currentMat.power = float(sceneFile.GetByNameAsFloat("Power", 0.0f)); 
 
+	selectSpecularEvaluator(&currentMat);
+	currentMat.textureCache = NULL;
+
+	return true;
+}
+
+// path of a model's mesh file (from its Mesh.File value), which is relative to the scene file unless it's absolute
+// returns false if the model's triangles are in the scene file itself
+bool GetMeshFileName(const Config &sceneFile, const char* inputName, char* fileName, size_t size)
+{
+	const char* name = sceneFile.GetByNameAsString("Mesh.File", "");
+	int length = int(strlen(name));
+	if (length == 0) return false;
+
+	// quotes are optional
+	if (length >= 2 && name[0] == '"' && name[length - 1] == '"')
+	{
+		name++;
+		length -= 2;
+	}
+
+	int directoryLength = 0;
+	if (name[0] != '/' && name[0] != '\\' && (length < 2 || name[1] != ':'))
+	{
+		const char* slash = std::max(strrchr(inputName, '/'), strrchr(inputName, '\\'));
+		if (slash != NULL) directoryLength = int(slash - inputName) + 1;
+	}
+
+	snprintf(fileName, size, "%.*s%.*s", directoryLength, inputName, length, name);
 	return true;
 }
 
-bool GetModel(const Config &sceneFile, const Scene& scene, int& triangleIndex)
+// split the current model section into chunks of triangles to be parsed (by ParseModelChunk)
+// models with a mesh file are read from it straight away instead (into the next of the scene's meshes)
+bool GetModel(const Config &sceneFile, const char* inputName, Scene& scene, int& triangleIndex, unsigned int& meshIndex, std::vector<ModelChunk>& chunks, unsigned int threads)
 {
-	Vector offset = sceneFile.GetByNameAsVector("Center", NullVector);
-	float scale = (float) sceneFile.GetByNameAsFloat("Size", 1);
+	ModelChunk chunk;
+	chunk.section = sceneFile.GetSection();
+	chunk.offset = sceneFile.GetByNameAsVector("Center", NullVector);
+	chunk.scale = (float) sceneFile.GetByNameAsFloat("Size", 1);
+	chunk.materialId = sceneFile.GetByNameAsInteger("Material.Id", 0);
+
+	char meshFileName[1024];
+	if (GetMeshFileName(sceneFile, inputName, meshFileName, sizeof(meshFileName)))
+	{
+		Mesh& mesh = scene.meshContainer[meshIndex++];
+		mesh.materialId = chunk.materialId;
+		return loadMeshFile(meshFileName, chunk.offset, chunk.scale, threads, &scene.arena, &mesh);
+	}
+
 	int numTriangles = sceneFile.GetByNameAsInteger("Triangles", 0);
-	int materialId = sceneFile.GetByNameAsInteger("Material.Id", 0);
 
-	for (int i = 0; i < numTriangles; i++)
+	for (int i = 0; i < numTriangles; i += MODEL_CHUNK_TRIANGLES)
 	{
-		Triangle& currentTriangle = scene.triangleContainer[triangleIndex + i];
+		chunk.first = i;
+		chunk.count = std::min(unsigned(numTriangles - i), MODEL_CHUNK_TRIANGLES);
+		chunk.output = &scene.triangleContainer[triangleIndex + i];
+		chunks.push_back(chunk);
+	}
 
-		SimpleString triangleName("Triangle");
-		triangleName.append((unsigned long)i);
+	// update the triangle index (so the next model's triangles are read into the correct spot)
+	triangleIndex += numTriangles;
 
-		currentTriangle = sceneFile.GetByNameAsTriangle(triangleName, Triangle());
-		currentTriangle.materialId = materialId;
+	return true;
+}
+
+// read, and move into place, a chunk of a model's triangles (safe to call from several threads at once)
+void ParseModelChunk(const Config &sceneFile, const ModelChunk& chunk)
+{
+	const Vector& offset = chunk.offset;
+	const float scale = chunk.scale;
+	char triangleName[32];
+
+	for (unsigned int i = 0; i < chunk.count; i++)
+	{
+		Triangle& currentTriangle = chunk.output[i];
+
+		snprintf(triangleName, sizeof(triangleName), "Triangle%u", chunk.first + i);
+
+		currentTriangle = sceneFile.GetByNameAsTriangle(chunk.section, triangleName, Triangle());
+		currentTriangle.materialId = chunk.materialId;
 
 		// calculate and store the normal of the triangle
 		Vector e1 = currentTriangle.p2 - currentTriangle.p1;
@@ -82,11 +169,27 @@ bool GetModel(const Config &sceneFile, const Scene& scene, int& triangleIndex)
 		currentTriangle.p2 = currentTriangle.p2 * scale + offset;
 		currentTriangle.p3 = currentTriangle.p3 * scale + offset;
 	}
+}
 
-	// update the triangle index (so the next model's triangles are read into the correct spot)
-	triangleIndex += numTriangles;
+// the models' triangles, parsed a chunk at a time by runJobs
+struct ModelJob
+{
+	const Config* sceneFile;
+	const ModelChunk* chunks;
+};
 
-	return true;
+static void parseModelJobChunk(void* data, unsigned int chunkIndex, unsigned int thread)
+{
+	const ModelJob* job = (const ModelJob*)data;
+	ParseModelChunk(*job->sceneFile, job->chunks[chunkIndex]);
+}
+
+// parse all the models' triangles, sharing the chunks out between the given number of threads
+// (with no more threads than chunks, so scenes without big models are parsed on the calling thread)
+void ParseModelChunks(const Config &sceneFile, const std::vector<ModelChunk>& chunks, unsigned int threads)
+{
+	ModelJob job = { &sceneFile, chunks.data() };
+	runJobs(parseModelJobChunk, &job, (unsigned int)chunks.size(), threads);
 }
 
 bool GetSphere(const Config &sceneFile, const Scene& scene, Sphere &currentSph)
@@ -111,19 +214,10 @@ void GetLight(const Config &sceneFile, Light &currentLight)
 	currentLight.intensity = sceneFile.GetByNameAsFloatOrColour("Intensity", 0.0f);
 }
 
-bool init(const char* inputName, Scene& scene)
+bool GetSceneSettings(const Config &sceneFile, Scene& scene)
 {
-//	int nbMats, nbSpheres, nbBlobs, nbLights, 
-	unsigned int versionMajor, versionMinor;
-	Config sceneFile(inputName);
-    if (sceneFile.SetSection("Scene") == -1)
-    {
-		fprintf(stderr, "Malformed Scene file: No Scene section.\n");
-		return false;
-    }
-
-	versionMajor = sceneFile.GetByNameAsInteger("Version.Major", 0);
-	versionMinor = sceneFile.GetByNameAsInteger("Version.Minor", 0);
+	unsigned int versionMajor = sceneFile.GetByNameAsInteger("Version.Major", 0);
+	unsigned int versionMinor = sceneFile.GetByNameAsInteger("Version.Minor", 0);
 
 	if (versionMajor != SCENE_VERSION_MAJOR || versionMinor != SCENE_VERSION_MINOR)
 	{
@@ -146,40 +240,87 @@ bool init(const char* inputName, Scene& scene)
 
 	scene.exposure = float(sceneFile.GetByNameAsFloat("Exposure", 1.0f));
 
-	scene.numMaterials = sceneFile.GetByNameAsInteger("NumberOfMaterials", 0);
-    scene.numSpheres = sceneFile.GetByNameAsInteger("NumberOfSpheres", 0);
-	scene.numLights = sceneFile.GetByNameAsInteger("NumberOfLights", 0);
+	return true;
+}
+
+bool init(const char* inputName, Scene& scene, unsigned int threads)
+{
+//	int nbMats, nbSpheres, nbBlobs, nbLights, 
+
+	// nothing has been allocated yet (so the scene can be destroyed whenever reading stops)
+	scene.numMaterials = scene.numSpheres = scene.numTriangles = scene.numLights = scene.numMeshes = 0;
+	scene.materialContainer = NULL;
+	scene.sphereContainer = NULL;
+	scene.triangleContainer = NULL;
+	scene.lightContainer = NULL;
+	scene.meshContainer = NULL;
+	scene.shadowMapContainer = NULL;
+	scene.bvh = NULL;
+	scene.cacheView = NULL;
+
+	Config sceneFile(inputName);
+    if (sceneFile.SetSection("Scene") == -1)
+    {
+		fprintf(stderr, "Malformed Scene file: No Scene section.\n");
+		return false;
+    }
+
+	// (which checks the file's version first)
+	if (!GetSceneSettings(sceneFile, scene))
+	{
+		return false;
+	}
+
+	unsigned int numMaterials = sceneFile.GetByNameAsInteger("NumberOfMaterials", 0);
+	unsigned int numSpheres = sceneFile.GetByNameAsInteger("NumberOfSpheres", 0);
+	unsigned int numLights = sceneFile.GetByNameAsInteger("NumberOfLights", 0);
 
 	unsigned int numModels = sceneFile.GetByNameAsInteger("NumberOfModels", 0);
 
 	// calculate the total number of triangles used by all models before allocating
-	// space for the triangle container
-	unsigned int numTriangles = 0;
+	// space for the triangle container (models read from mesh files have their own storage)
+	unsigned int numTriangles = 0, numMeshes = 0;
+	char meshFileName[1024];
 	for (unsigned int i = 0; i < numModels; ++i)
 	{
-		SimpleString sectionName("Model");
-		sectionName.append((unsigned long)i);
+		char sectionName[32];
+		snprintf(sectionName, sizeof(sectionName), "Model%u", i);
 		if (sceneFile.SetSection(sectionName) == -1)
 		{
 			fprintf(stderr, "Malformed Scene file: Missing Model section.\n");
 			return false;
 		}
-		numTriangles += sceneFile.GetByNameAsInteger("Triangles", 0);
+		if (GetMeshFileName(sceneFile, inputName, meshFileName, sizeof(meshFileName)))
+			numMeshes++;
+		else
+			numTriangles += sceneFile.GetByNameAsInteger("Triangles", 0);
 	}
-	scene.numTriangles = numTriangles;
 
-	scene.materialContainer = new Material[scene.numMaterials];
-	scene.sphereContainer = new Sphere[scene.numSpheres];
-	scene.lightContainer = new Light[scene.numLights];
-	scene.triangleContainer = new Triangle[scene.numTriangles];
+	// the containers are carved out of a single block of the arena, each starting on a cache line
+	// (the triangles go last, so indexSceneTriangles can release them without leaving a gap between the others)
+	const size_t containerBytes[5] = { numMaterials * sizeof(Material), numSpheres * sizeof(Sphere), numLights * sizeof(Light),
+		numMeshes * sizeof(Mesh), (size_t)numTriangles * sizeof(Triangle) };
+	reserveSceneArena(&scene.arena, containerBytes[0] + containerBytes[1] + containerBytes[2] + containerBytes[3] + containerBytes[4] + 5 * SCENE_ARENA_ALIGNMENT);
+
+	scene.materialContainer = (Material*)allocateSceneArena(&scene.arena, containerBytes[0]);
+	scene.sphereContainer = (Sphere*)allocateSceneArena(&scene.arena, containerBytes[1]);
+	scene.lightContainer = (Light*)allocateSceneArena(&scene.arena, containerBytes[2]);
+	scene.meshContainer = (Mesh*)allocateSceneArena(&scene.arena, containerBytes[3]);
+	scene.triangleContainer = (Triangle*)allocateSceneArena(&scene.arena, containerBytes[4]);
+
+	scene.numMaterials = numMaterials;
+	scene.numSpheres = numSpheres;
+	scene.numLights = numLights;
+	scene.numTriangles = numTriangles;
+	scene.numMeshes = numMeshes;
 
 	// have to read the materials section before the material ids (used for the triangles, 
 	// spheres, and planes) can be turned into pointers to actual materials
 	for (unsigned int i = 0; i < scene.numMaterials; ++i)
     {   
         Material &currentMat = scene.materialContainer[i];
-        SimpleString sectionName("Material");
-        sectionName.append((unsigned long) i);
+        char sectionName[32];
+        snprintf(sectionName, sizeof(sectionName), "Material%u", i);
         if (sceneFile.SetSection( sectionName ) == -1)
         {
 			fprintf(stderr, "Malformed Scene file: Missing Material section.\n");
@@ -193,28 +334,34 @@ bool init(const char* inputName, Scene& scene)
     }
 
 	int triangleIndex = 0;
+	unsigned int meshIndex = 0;
+	std::vector<ModelChunk> chunks;
 
 	for (unsigned int i = 0; i < numModels; ++i)
 	{
-		SimpleString sectionName("Model");
-		sectionName.append((unsigned long)i);
+		char sectionName[32];
+		snprintf(sectionName, sizeof(sectionName), "Model%u", i);
 		if (sceneFile.SetSection(sectionName) == -1)
 		{
 			fprintf(stderr, "Malformed Scene file: Missing Model section.\n");
 			return false;
 		}
-		if (!GetModel(sceneFile, scene, triangleIndex))
+		if (!GetModel(sceneFile, inputName, scene, triangleIndex, meshIndex, chunks, threads))
 		{
 			fprintf(stderr, "Malformed Scene file: Model %d section.\n", i);
 			return false;
 		}
 	}
 
+	// the triangles themselves are read in parallel (each chunk already knows where its triangles go)
+	ParseModelChunks(sceneFile, chunks, threads);
+	numberMeshTriangles(&scene);
+
 	for (unsigned int i = 0; i < scene.numSpheres; ++i)
     {   
         Sphere &currentSphere = scene.sphereContainer[i];
-        SimpleString sectionName("Sphere");
-        sectionName.append((unsigned long) i);
+        char sectionName[32];
+        snprintf(sectionName, sizeof(sectionName), "Sphere%u", i);
         if (sceneFile.SetSection( sectionName ) == -1)
         {
 			fprintf(stderr, "Malformed Scene file: Missing Sphere section.\n");
@@ -230,8 +377,8 @@ bool init(const char* inputName, Scene& scene)
 	for (unsigned int i = 0; i < scene.numLights; ++i)
     {   
         Light &currentLight = scene.lightContainer[i];
-        SimpleString sectionName("Light");
-        sectionName.append((unsigned long) i);
+        char sectionName[32];
+        snprintf(sectionName, sizeof(sectionName), "Light%u", i);
         if (sceneFile.SetSection( sectionName ) == -1)
         {
 			fprintf(stderr, "Malformed Scene file: Missing Light section.\n");
@@ -243,3 +390,21 @@ bool init(const char* inputName, Scene& scene)
 	return true;
 }
 
+
+// free everything belonging to a scene, leaving it empty
+void destroyScene(Scene* scene)
+{
+	// (the texture caches hang off the materials, so have to go before the cache mapping and arena holding them)
+	destroyBvh(scene);
+	destroyShadowMaps(scene);
+	destroyTextureCaches(scene);
+	unloadSceneCache(scene);
+	destroySceneArena(&scene->arena);
+
+	scene->numMaterials = scene->numSpheres = scene->numTriangles = scene->numLights = scene->numMeshes = 0;
+	scene->materialContainer = NULL;
+	scene->sphereContainer = NULL;
+	scene->triangleContainer = NULL;
+	scene->lightContainer = NULL;
+	scene->meshContainer = NULL;
+}
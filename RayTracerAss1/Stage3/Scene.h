@@ -8,6 +8,9 @@
 #define __SCENE_H
 
 #include "SceneObjects.h"
+#include "SceneArena.h"
+
+class Config;
 
 // description of a single static scene
 typedef struct Scene 
@@ -25,14 +28,40 @@ typedef struct Scene
 	unsigned int numSpheres;
 	unsigned int numTriangles;
 	unsigned int numLights;
+	unsigned int numMeshes;
 
-	// scene objects
+	// scene objects (allocated from the scene's arena, or pointing into its cache)
 	Material* materialContainer;	
 	Sphere* sphereContainer;
 	Triangle* triangleContainer;
 	Light* lightContainer;
+	Mesh* meshContainer;
+
+	// optional approximate shadows (one per light, NULL when using exact shadow rays)
+	struct ShadowMap* shadowMapContainer;
+
+	// optional bounding volume hierarchy over all the objects (NULL when every object is tested against every ray)
+	struct Bvh* bvh;
+
+	// mapping of the compiled scene cache the containers point into (NULL when the scene was read from its text file)
+	void* cacheView;
+
+	// memory holding the scene's objects (set up with createSceneArena before the scene is read)
+	SceneArena arena;
 } Scene;
 
-bool init(const char* inputName, Scene& scene);
+// read a scene file, with the models' triangles read by the given number of threads
+// the scene's arena has to have been set up already, and the scene has to be destroyed with destroyScene afterwards (even if reading fails)
+bool init(const char* inputName, Scene& scene, unsigned int threads);
+
+// read the object (or, for the Scene section, the camera, exposure and skybox, once the file's version has been checked) in the scene file's current section
+// these are what init reads each section with, so a single edited section can be read again into an existing scene
+bool GetSceneSettings(const Config &sceneFile, Scene& scene);
+bool GetMaterial(const Config &sceneFile, Material &currentMat);
+bool GetSphere(const Config &sceneFile, const Scene& scene, Sphere &currentSph);
+void GetLight(const Config &sceneFile, Light &currentLight);
+
+// free everything belonging to a scene (its objects, hierarchy, shadow maps, texture caches, and cache mappings), leaving it empty with its arena ready for the next scene
+void destroyScene(Scene* scene);
 
 #endif // __SCENE_H
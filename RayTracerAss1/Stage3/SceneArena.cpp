@@ -0,0 +1,185 @@
+#define NOMINMAX
+#include <windows.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
+#include <new>
+
+#include "SceneArena.h"
+
+// smallest block the arena allocates (allocations bigger than half of this get a block to themselves)
+const size_t SCENE_ARENA_BLOCK_BYTES = 4 * 1024 * 1024;
+
+// header at the start of each block, followed by the block's allocations
+typedef struct SceneArenaBlock
+{
+	struct SceneArenaBlock* previous;	// next block to free (NULL for the last)
+	size_t size;						// bytes in the block, including this header
+	size_t used;						// bytes handed out so far, including this header
+	bool largePages;					// backed by large pages (so can't be partly released)
+} SceneArenaBlock;
+
+static inline size_t roundUp(size_t bytes, size_t multiple)
+{
+	return (bytes + multiple - 1) / multiple * multiple;
+}
+
+// space taken by a block's header (the first allocation starts on the cache line after it)
+static const size_t BLOCK_HEADER_BYTES = roundUp(sizeof(SceneArenaBlock), SCENE_ARENA_ALIGNMENT);
+
+
+// switch on the privilege large pages need (the user has to have been granted it already)
+static bool enableLargePages()
+{
+	HANDLE token;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES, &token)) return false;
+
+	TOKEN_PRIVILEGES privileges;
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+	// AdjustTokenPrivileges succeeds without enabling anything when the privilege hasn't been granted
+	bool enabled = LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid)
+		&& AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) && GetLastError() == ERROR_SUCCESS;
+
+	CloseHandle(token);
+	return enabled;
+}
+
+
+// set up an empty arena (no memory is allocated until it's used)
+void createSceneArena(SceneArena* arena, bool largePages)
+{
+	arena->blocks = NULL;
+	arena->committedBytes = 0;
+	arena->largePages = largePages && GetLargePageMinimum() > 0 && enableLargePages();
+
+	if (largePages && !arena->largePages)
+	{
+		printf("Scene arena: large pages aren't available (they need the Lock pages in memory privilege), using normal pages\n");
+	}
+}
+
+
+// add a block with room for at least the given number of bytes, making it the block allocations come from
+static SceneArenaBlock* addBlock(SceneArena* arena, size_t bytes)
+{
+	size_t size = std::max(BLOCK_HEADER_BYTES + bytes, SCENE_ARENA_BLOCK_BYTES);
+	void* memory = NULL;
+	bool largePages = false;
+
+	if (arena->largePages)
+	{
+		size_t largeSize = roundUp(size, GetLargePageMinimum());
+		memory = VirtualAlloc(NULL, largeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+
+		if (memory != NULL)
+		{
+			size = largeSize;
+			largePages = true;
+		}
+		else
+		{
+			// physical memory is too fragmented for large pages, which doesn't usually get better
+			printf("Scene arena: couldn't get %.1fMB of large pages, using normal pages\n", largeSize / (1024.0 * 1024.0));
+			arena->largePages = false;
+		}
+	}
+
+	if (memory == NULL)
+	{
+		// a whole number of allocation granules (address space is handed out 64KB at a time anyway)
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		size = roundUp(size, info.dwAllocationGranularity);
+
+		memory = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (memory == NULL) throw std::bad_alloc();
+	}
+
+	SceneArenaBlock* block = (SceneArenaBlock*)memory;
+	block->previous = arena->blocks;
+	block->size = size;
+	block->used = BLOCK_HEADER_BYTES;
+	block->largePages = largePages;
+
+	arena->blocks = block;
+	arena->committedBytes += size;
+	return block;
+}
+
+
+// make sure the next allocations (totalling up to the given size, including their alignment) all come from one block
+void reserveSceneArena(SceneArena* arena, size_t bytes)
+{
+	const SceneArenaBlock* block = arena->blocks;
+	if (block == NULL || block->size - block->used < bytes) addBlock(arena, bytes);
+}
+
+
+// allocate zeroed, cache line aligned, memory that lasts until the arena is destroyed
+void* allocateSceneArena(SceneArena* arena, size_t bytes)
+{
+	// (fresh pages are always zeroed, and the arena never hands out memory twice)
+	bytes = roundUp(std::max(bytes, (size_t)1), SCENE_ARENA_ALIGNMENT);
+
+	SceneArenaBlock* block = arena->blocks;
+	if (block == NULL || block->size - block->used < bytes)
+	{
+		SceneArenaBlock* current = block;
+		block = addBlock(arena, bytes);
+
+		// a big allocation goes behind the current block, which keeps its space for the smaller allocations that follow
+		if (current != NULL && bytes > SCENE_ARENA_BLOCK_BYTES / 2)
+		{
+			arena->blocks = current;
+			block->previous = current->previous;
+			current->previous = block;
+		}
+	}
+
+	void* memory = (char*)block + block->used;
+	block->used += bytes;
+	return memory;
+}
+
+
+// give the whole pages of an allocation that's no longer needed back to the system
+void releaseSceneArena(SceneArena* arena, void* memory, size_t bytes)
+{
+	if (memory == NULL) return;
+
+	for (SceneArenaBlock* block = arena->blocks; block != NULL; block = block->previous)
+	{
+		uintptr_t start = (uintptr_t)block;
+		if ((uintptr_t)memory < start || (uintptr_t)memory >= start + block->size) continue;
+		if (block->largePages) return;
+
+		// only pages entirely inside the allocation (the ones at either end are shared with its neighbours)
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		uintptr_t first = roundUp((uintptr_t)memory, info.dwPageSize);
+		uintptr_t last = ((uintptr_t)memory + bytes) / info.dwPageSize * info.dwPageSize;
+
+		if (last > first)
+		{
+			VirtualFree((void*)first, last - first, MEM_DECOMMIT);
+			arena->committedBytes -= last - first;
+		}
+		return;
+	}
+}
+
+
+// free all of the arena's blocks, leaving it empty
+void destroySceneArena(SceneArena* arena)
+{
+	while (arena->blocks != NULL)
+	{
+		SceneArenaBlock* block = arena->blocks;
+		arena->blocks = block->previous;
+		VirtualFree(block, 0, MEM_RELEASE);
+	}
+
+	arena->committedBytes = 0;
+}
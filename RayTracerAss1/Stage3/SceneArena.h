@@ -0,0 +1,34 @@
+#ifndef __SCENE_ARENA_H
+#define __SCENE_ARENA_H
+
+#include <stddef.h>
+
+// every allocation from an arena starts on a cache line
+#define SCENE_ARENA_ALIGNMENT 64
+
+// memory for a scene's objects, handed out from a few large blocks (optionally backed by large pages) that are all freed together
+typedef struct SceneArena
+{
+	struct SceneArenaBlock* blocks;		// block currently being allocated from (linked to the blocks before it)
+	bool largePages;					// back new blocks with large pages (cleared if they turn out to be unavailable)
+	size_t committedBytes;				// memory held by the blocks, less any given back by releaseSceneArena
+} SceneArena;
+
+// set up an empty arena (no memory is allocated until it's used)
+// large pages need the "Lock pages in memory" privilege, without it the arena says so and uses normal pages
+void createSceneArena(SceneArena* arena, bool largePages);
+
+// make sure the next allocations (totalling up to the given size, including their alignment) all come from one block
+void reserveSceneArena(SceneArena* arena, size_t bytes);
+
+// allocate zeroed, cache line aligned, memory that lasts until the arena is destroyed (throws std::bad_alloc if there's no memory left)
+void* allocateSceneArena(SceneArena* arena, size_t bytes);
+
+// give the whole pages of an allocation that's no longer needed back to the system (its address range stays reserved)
+// does nothing for blocks backed by large pages, which can't be partly freed
+void releaseSceneArena(SceneArena* arena, void* memory, size_t bytes);
+
+// free all of the arena's blocks, leaving it empty (and ready to be used again)
+void destroySceneArena(SceneArena* arena);
+
+#endif // __SCENE_ARENA_H
@@ -0,0 +1,203 @@
+#define NOMINMAX
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "SceneCache.h"
+#include "CacheFile.h"
+
+#pragma warning(disable: 4996)
+
+// bump whenever the layout of the cache (or of the scene objects stored in it) changes
+const unsigned int SCENE_CACHE_VERSION = 1;
+
+// alignment of the object arrays within the cache
+const unsigned long long SCENE_CACHE_ALIGNMENT = 64;
+
+// start of a compiled scene file, followed by the object arrays
+typedef struct SceneCacheHeader
+{
+	char magic[8];							// "RTSCENE"
+	unsigned int version;					// SCENE_CACHE_VERSION
+	unsigned int objectSizes[4];			// sizes of Material, Sphere, Triangle and Light (catches layout changes between builds)
+	unsigned long long sourceHash;			// hash of the text file the scene was compiled from
+	unsigned long long sourceSize;			// size of the text file
+
+	// scene settings
+	Point cameraPosition;
+	float cameraRotation;
+	float cameraFieldOfView;
+	float exposure;
+	unsigned int skyboxMaterialId;
+
+	// object counts, and where each array starts in the file
+	unsigned int numMaterials, numSpheres, numTriangles, numLights;
+	unsigned long long materialOffset, sphereOffset, triangleOffset, lightOffset;
+} SceneCacheHeader;
+
+static const char SCENE_CACHE_MAGIC[8] = "RTSCENE";
+
+
+// hash and size of a text scene file, returns false if it can't be read
+static bool hashSourceFile(const char* inputName, unsigned long long* hash, unsigned long long* size)
+{
+	const char* source = mapFile(inputName, false, size);
+	if (source == NULL) return false;
+
+	*hash = fnv1a(FNV1A_OFFSET_BASIS, source, (size_t)*size);
+
+	UnmapViewOfFile(source);
+	return true;
+}
+
+
+// object sizes, counts and offsets of a header, with the arrays laid out one after another
+static void setHeaderLayout(SceneCacheHeader* header, unsigned int numMaterials, unsigned int numSpheres, unsigned int numTriangles, unsigned int numLights)
+{
+	header->objectSizes[0] = sizeof(Material);
+	header->objectSizes[1] = sizeof(Sphere);
+	header->objectSizes[2] = sizeof(Triangle);
+	header->objectSizes[3] = sizeof(Light);
+
+	header->numMaterials = numMaterials;
+	header->numSpheres = numSpheres;
+	header->numTriangles = numTriangles;
+	header->numLights = numLights;
+
+	unsigned long long offset = sizeof(SceneCacheHeader);
+	const unsigned long long mask = SCENE_CACHE_ALIGNMENT - 1;
+
+	offset = (offset + mask) & ~mask;
+	header->materialOffset = offset;
+	offset += (unsigned long long)numMaterials * sizeof(Material);
+
+	offset = (offset + mask) & ~mask;
+	header->sphereOffset = offset;
+	offset += (unsigned long long)numSpheres * sizeof(Sphere);
+
+	offset = (offset + mask) & ~mask;
+	header->triangleOffset = offset;
+	offset += (unsigned long long)numTriangles * sizeof(Triangle);
+
+	offset = (offset + mask) & ~mask;
+	header->lightOffset = offset;
+}
+
+
+// header for a scene
+static void fillHeader(const Scene* scene, unsigned long long sourceHash, unsigned long long sourceSize, SceneCacheHeader* header)
+{
+	memset(header, 0, sizeof(SceneCacheHeader));
+	memcpy(header->magic, SCENE_CACHE_MAGIC, sizeof(header->magic));
+	header->version = SCENE_CACHE_VERSION;
+	header->sourceHash = sourceHash;
+	header->sourceSize = sourceSize;
+
+	header->cameraPosition = scene->cameraPosition;
+	header->cameraRotation = scene->cameraRotation;
+	header->cameraFieldOfView = scene->cameraFieldOfView;
+	header->exposure = scene->exposure;
+	header->skyboxMaterialId = scene->skyboxMaterialId;
+
+	setHeaderLayout(header, scene->numMaterials, scene->numSpheres, scene->numTriangles, scene->numLights);
+}
+
+
+// load a scene from its compiled cache, if there is one and it was compiled from the text file as it is now
+bool loadSceneCache(const char* inputName, Scene* scene)
+{
+	unsigned long long sourceHash, sourceSize;
+	if (!hashSourceFile(inputName, &sourceHash, &sourceSize)) return false;
+
+	char cacheName[1024];
+	getCacheName(inputName, SCENE_CACHE_EXTENSION, cacheName, sizeof(cacheName));
+
+	// copy on write, so the materials can be patched up (and texture caches attached) without touching the file
+	unsigned long long fileSize;
+	char* view = (char*)mapFile(cacheName, true, &fileSize);
+	if (view == NULL) return false;
+	if (fileSize < sizeof(SceneCacheHeader))
+	{
+		UnmapViewOfFile(view);
+		return false;
+	}
+
+	// the cache has to match the text file, and the layout has to match this build
+	const SceneCacheHeader* header = (const SceneCacheHeader*)view;
+	// (laid out from the counts in the file, as this build would lay them out)
+	SceneCacheHeader expected;
+	memset(&expected, 0, sizeof(expected));
+	setHeaderLayout(&expected, header->numMaterials, header->numSpheres, header->numTriangles, header->numLights);
+
+	if (memcmp(header->magic, SCENE_CACHE_MAGIC, sizeof(header->magic)) != 0 || header->version != SCENE_CACHE_VERSION
+		|| memcmp(header->objectSizes, expected.objectSizes, sizeof(expected.objectSizes)) != 0
+		|| header->sourceHash != sourceHash || header->sourceSize != sourceSize
+		|| header->materialOffset != expected.materialOffset || header->sphereOffset != expected.sphereOffset
+		|| header->triangleOffset != expected.triangleOffset || header->lightOffset != expected.lightOffset
+		|| fileSize < expected.lightOffset + (unsigned long long)header->numLights * sizeof(Light))
+	{
+		UnmapViewOfFile(view);
+		return false;
+	}
+
+	scene->cameraPosition = header->cameraPosition;
+	scene->cameraRotation = header->cameraRotation;
+	scene->cameraFieldOfView = header->cameraFieldOfView;
+	scene->exposure = header->exposure;
+	scene->skyboxMaterialId = header->skyboxMaterialId;
+
+	scene->numMaterials = header->numMaterials;
+	scene->numSpheres = header->numSpheres;
+	scene->numTriangles = header->numTriangles;
+	scene->numLights = header->numLights;
+	scene->numMeshes = 0;
+
+	scene->materialContainer = (Material*)(view + header->materialOffset);
+	scene->sphereContainer = (Sphere*)(view + header->sphereOffset);
+	scene->triangleContainer = (Triangle*)(view + header->triangleOffset);
+	scene->lightContainer = (Light*)(view + header->lightOffset);
+	scene->meshContainer = NULL;
+	scene->shadowMapContainer = NULL;
+	scene->bvh = NULL;
+	scene->cacheView = view;
+
+	// pointers saved in the file are meaningless now
+	for (unsigned int i = 0; i < scene->numMaterials; ++i)
+		scene->materialContainer[i].textureCache = NULL;
+
+	return true;
+}
+
+
+// write the compiled cache of a scene which has just been read from its text file
+bool saveSceneCache(const char* inputName, const Scene* scene)
+{
+	// scenes with mesh files aren't cached (the meshes are already read straight from a mapped file, and could change behind the cache's back)
+	if (scene->numMeshes > 0) return true;
+
+	unsigned long long sourceHash, sourceSize;
+	if (!hashSourceFile(inputName, &sourceHash, &sourceSize)) return false;
+
+	SceneCacheHeader header;
+	fillHeader(scene, sourceHash, sourceSize, &header);
+
+	char cacheName[1024];
+	getCacheName(inputName, SCENE_CACHE_EXTENSION, cacheName, sizeof(cacheName));
+
+	const void* blocks[4] = { scene->materialContainer, scene->sphereContainer, scene->triangleContainer, scene->lightContainer };
+	const unsigned long long offsets[4] = { header.materialOffset, header.sphereOffset, header.triangleOffset, header.lightOffset };
+	const unsigned long long sizes[4] = { (unsigned long long)scene->numMaterials * sizeof(Material), (unsigned long long)scene->numSpheres * sizeof(Sphere),
+		(unsigned long long)scene->numTriangles * sizeof(Triangle), (unsigned long long)scene->numLights * sizeof(Light) };
+
+	return writeCacheFile(cacheName, &header, sizeof(header), 4, blocks, offsets, sizes);
+}
+
+
+// unmap the cache a scene was loaded from (does nothing for scenes read from text)
+void unloadSceneCache(Scene* scene)
+{
+	if (scene->cacheView == NULL) return;
+
+	UnmapViewOfFile(scene->cacheView);
+	scene->cacheView = NULL;
+}
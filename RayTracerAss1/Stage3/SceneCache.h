@@ -0,0 +1,22 @@
+#ifndef __SCENE_CACHE_H
+#define __SCENE_CACHE_H
+
+#include "Scene.h"
+
+// compiled scenes are cached next to their text file, with this appended to the name
+#define SCENE_CACHE_EXTENSION ".rtscene"
+
+// load a scene from its compiled cache, if there is one and it was compiled from the text file as it is now
+// the scene's containers point straight into a (copy on write) mapping of the cache file
+// returns false if the cache is missing or out of date (the scene is left untouched)
+bool loadSceneCache(const char* inputName, Scene* scene);
+
+// write the compiled cache of a scene which has just been read from its text file
+// scenes that read models from mesh files aren't cached
+// returns false if the cache couldn't be written
+bool saveSceneCache(const char* inputName, const Scene* scene);
+
+// unmap the cache a scene was loaded from (does nothing for scenes read from text)
+void unloadSceneCache(Scene* scene);
+
+#endif // __SCENE_CACHE_H
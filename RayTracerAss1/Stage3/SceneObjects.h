@@ -24,9 +24,15 @@ typedef struct Material
 	Colour specular;			// colour of specular lighting
 	float power;				// power of specular reflection
 
+	// how the specular power is evaluated (chosen at load by selectSpecularEvaluator)
+	enum { SPECULAR_NONE, SPECULAR_INTEGER, SPECULAR_GENERAL } specularType;
+	unsigned int integerPower;	// power as an integer, only for SPECULAR_INTEGER types
+
 	float reflection;			// reflection amount
 	float refraction;			// refraction amount
 	float density;				// density of material (affects amount of defraction)
+
+	struct TextureCache* textureCache;	// optional baked texture (NULL when the texture is computed directly)
 } Material;
 
 
@@ -55,4 +61,29 @@ typedef struct Triangle
 	unsigned int materialId;	// material id
 } Triangle;
 
+// indexed triangle mesh (a model read from an OBJ or PLY file, or welded from the scene file's triangles), vertices are shared between triangles
+// vertices are either full floats, or 16 bit steps across the mesh's bounds (quantized), and triangle normals are worked out when needed
+typedef struct Mesh
+{
+	unsigned int numVertices;
+	unsigned int numTriangles;
+	Point* vertices;			// vertex positions (already scaled and moved into place), NULL when quantized
+	unsigned short* quantized;	// three steps per vertex, NULL unless quantized
+	Point origin;				// position of step 0 along each axis (quantized only)
+	Vector step;				// size of a step along each axis (quantized only)
+	unsigned int* indices;		// three vertex indices per triangle
+	unsigned int materialId;	// material id
+	unsigned int firstTriangle;	// number of the mesh's first triangle, counting the triangles of all the scene's meshes in turn
+} Mesh;
+
+// position of one of a mesh's vertices
+inline Point getMeshVertex(const Mesh* mesh, unsigned int index)
+{
+	if (mesh->quantized == NULL) return mesh->vertices[index];
+
+	const unsigned short* steps = &mesh->quantized[index * 3];
+	Point vertex = { mesh->origin.x + steps[0] * mesh->step.x, mesh->origin.y + steps[1] * mesh->step.y, mesh->origin.z + steps[2] * mesh->step.z };
+	return vertex;
+}
+
 #endif // __SCENE_OBJECTS_H
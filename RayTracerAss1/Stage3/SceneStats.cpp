@@ -0,0 +1,199 @@
+#define TARGET_WINDOWS
+#define NOMINMAX
+#include <windows.h>
+#include <stdio.h>
+
+#include "SceneStats.h"
+#include "Config.h"
+#include "Mesh.h"
+#include "Bvh.h"
+#include "ShadowMap.h"
+#include "Timer.h"
+
+// pixels traced by each pass of the render estimate are this far apart along each axis (so a pass traces 1/64th of the image)
+const int STATS_PIXEL_STRIDE = 8;
+
+// the render estimate keeps taking passes until it has spent this long (in ms), unless it runs out of pixels first
+const unsigned int STATS_ESTIMATE_MS = 250;
+
+// most models listed individually
+const unsigned int STATS_MAX_MODELS = 32;
+
+
+// print a line of the container report, with the memory in the most readable unit
+static void printContainer(const char* name, unsigned long long count, unsigned long long bytes, const char* note)
+{
+	if (bytes >= 1024 * 1024)
+		printf("  %-12s %10llu  %9.2fMB%s\n", name, count, bytes / (1024.0 * 1024.0), note);
+	else
+		printf("  %-12s %10llu  %9.2fKB%s\n", name, count, bytes / 1024.0, note);
+}
+
+
+// print the triangles in each of the scene file's models (models read from mesh files are the first of the scene's meshes, in order)
+static void reportModels(const char* inputName, const Scene* scene)
+{
+	Config sceneFile(inputName);
+	if (sceneFile.SetSection("Scene") == -1) return;
+
+	unsigned int numModels = sceneFile.GetByNameAsInteger("NumberOfModels", 0);
+	unsigned int meshIndex = 0;
+	if (numModels > 0) printf("Models:\n");
+
+	for (unsigned int i = 0; i < numModels; ++i)
+	{
+		char sectionName[32];
+		snprintf(sectionName, sizeof(sectionName), "Model%u", i);
+		if (sceneFile.SetSection(sectionName) == -1) break;
+
+		const char* meshFile = sceneFile.GetByNameAsString("Mesh.File", "");
+		bool fromFile = meshFile[0] != '\0' && meshIndex < scene->numMeshes;
+		unsigned int numTriangles = fromFile ? scene->meshContainer[meshIndex++].numTriangles : (unsigned int)sceneFile.GetByNameAsInteger("Triangles", 0);
+
+		if (i < STATS_MAX_MODELS)
+		{
+			printf("  Model%-6u %10u triangles%s%s\n", i, numTriangles, fromFile ? " from " : "", fromFile ? meshFile : "");
+		}
+	}
+
+	if (numModels > STATS_MAX_MODELS) printf("  (and %u more)\n", numModels - STATS_MAX_MODELS);
+}
+
+
+// print the number and memory use of each of the scene's containers, the triangles in each model, and the mix of materials
+void reportSceneStats(const char* inputName, const Scene* scene)
+{
+	const char* source = scene->cacheView != NULL ? " (mapped from the compiled cache)" : "";
+
+	unsigned long long meshTriangles = 0, meshVertices = 0, meshBytes = 0;
+	for (unsigned int m = 0; m < scene->numMeshes; ++m)
+	{
+		meshTriangles += scene->meshContainer[m].numTriangles;
+		meshVertices += scene->meshContainer[m].numVertices;
+		meshBytes += sizeof(Mesh) + getMeshBytes(&scene->meshContainer[m]);
+	}
+
+	printf("Scene containers:\n");
+	printContainer("Materials", scene->numMaterials, (unsigned long long)scene->numMaterials * sizeof(Material), source);
+	printContainer("Spheres", scene->numSpheres, (unsigned long long)scene->numSpheres * sizeof(Sphere), source);
+	printContainer("Triangles", scene->numTriangles, (unsigned long long)scene->numTriangles * sizeof(Triangle), source);
+	printContainer("Lights", scene->numLights, (unsigned long long)scene->numLights * sizeof(Light), source);
+	printContainer("Meshes", scene->numMeshes, meshBytes, "");
+	if (scene->numMeshes > 0) printf("  %-12s %10llu triangles, %llu vertices\n", "", meshTriangles, meshVertices);
+
+	if (scene->bvh != NULL)
+	{
+		printContainer("BVH nodes", scene->bvh->numNodes, (unsigned long long)scene->bvh->numNodes * sizeof(BvhNode) + (unsigned long long)scene->bvh->numObjects * 2 * sizeof(unsigned int),
+			scene->bvh->cacheView != NULL ? " (mapped from its cache)" : "");
+	}
+
+	if (scene->shadowMapContainer != NULL)
+	{
+		unsigned long long shadowMapBytes = 0;
+		for (unsigned int i = 0; i < scene->numLights; ++i)
+			shadowMapBytes += 6ull * scene->shadowMapContainer[i].resolution * scene->shadowMapContainer[i].resolution * sizeof(float);
+
+		printContainer("Shadow maps", scene->numLights, shadowMapBytes, "");
+	}
+
+	printf("  Scene arena: %.2fMB committed\n", scene->arena.committedBytes / (1024.0 * 1024.0));
+
+	reportModels(inputName, scene);
+
+	unsigned int reflective = 0, refractive = 0, textured = 0;
+	for (unsigned int i = 0; i < scene->numMaterials; ++i)
+	{
+		const Material& material = scene->materialContainer[i];
+		reflective += material.reflection > 0.0f;
+		refractive += material.refraction > 0.0f;
+		textured += material.type != Material::GOURAUD;
+	}
+
+	printf("Lights: %u\n", scene->numLights);
+	printf("Materials: %u (%u reflective, %u refractive, %u textured)\n", scene->numMaterials, reflective, refractive, textured);
+}
+
+
+// follow a path to its end (as finishPath does), counting the rays it casts and how many of them hit an object
+static void traceCountedPath(const Scene* scene, const RenderOptions* options, const Ray* viewRay, unsigned long long* rays, unsigned long long* hits)
+{
+	RayPath path;
+	startPath(&path, viewRay);
+
+	Intersection intersect;
+	for (; path.level < MAX_RAYS_CAST; ++path.level)
+	{
+		if (!continuePath(options, &path)) return;
+
+		++*rays;
+		if (!objectIntersection(scene, &path.ray, &intersect)) break;
+
+		++*hits;
+		calculateIntersectionResponse(scene, &path.ray, &intersect);
+
+		if (!shadePath(scene, &path, &intersect)) return;
+	}
+
+	endPathAtSkybox(scene, &path);
+}
+
+
+// trace a sample of the image's pixels to estimate the rays cast per pixel and how long the image will take
+void reportRenderEstimate(const Scene* scene, const RenderOptions* options, unsigned int threads)
+{
+	Camera camera;
+	createCamera(&camera, scene, options->width, options->height);
+
+	const SamplePattern* pattern = &options->samplePattern;
+	const Tile* crop = &options->crop;
+	const int numPasses = STATS_PIXEL_STRIDE * STATS_PIXEL_STRIDE;
+
+	unsigned long long pixels = 0, rays = 0, hits = 0;
+	int passes = 0;
+	Timer timer;
+
+	while (passes < numPasses)
+	{
+		// each pass starts from a different pixel of the first 8x8 block, so no pixel is traced twice
+		const int offsetX = passes % STATS_PIXEL_STRIDE, offsetY = passes / STATS_PIXEL_STRIDE;
+
+		for (int py = crop->startY + offsetY; py < crop->endY; py += STATS_PIXEL_STRIDE)
+		{
+			const int y = py - camera.centreY;
+			for (int px = crop->startX + offsetX; px < crop->endX; px += STATS_PIXEL_STRIDE)
+			{
+				const int x = px - camera.centreX;
+
+				const float* sampleX, * sampleY;
+				getPixelSamples(pattern, x, y, &sampleX, &sampleY);
+
+				for (unsigned int s = 0; s < pattern->samplesPerPixel; s++)
+				{
+					Ray viewRay = getCameraRay(&camera, x + sampleX[s], y + sampleY[s]);
+					traceCountedPath(scene, options, &viewRay, &rays, &hits);
+				}
+
+				pixels++;
+			}
+		}
+
+		passes++;
+		timer.end();
+		if (timer.getMilliseconds() >= STATS_ESTIMATE_MS) break;
+	}
+
+	if (pixels == 0) return;
+
+	const unsigned long long imagePixels = (unsigned long long)(crop->endX - crop->startX) * (crop->endY - crop->startY);
+	const double primaryPerPixel = double(pattern->samplesPerPixel);
+	const double pathRaysPerPixel = double(rays) / pixels;
+
+	// every hit casts a shadow ray towards each light it faces (so this is an upper bound), unless the shadows come from shadow maps
+	const double shadowRaysPerPixel = scene->shadowMapContainer != NULL ? 0.0 : double(hits) * scene->numLights / pixels;
+
+	printf("Estimate (%llu of %llu pixels traced in %ums):\n", pixels, imagePixels, timer.getMilliseconds());
+	printf("  Rays per pixel: %.2f (%.2f primary, %.2f reflected or refracted, up to %.2f shadow)\n", pathRaysPerPixel + shadowRaysPerPixel,
+		primaryPerPixel, pathRaysPerPixel - primaryPerPixel, shadowRaysPerPixel);
+	printf("  Projected render time: %.2fs for %dx%d at %u samples per pixel on %u thread(s)\n",
+		timer.getMilliseconds() / 1000.0 * imagePixels / pixels / threads, crop->endX - crop->startX, crop->endY - crop->startY, pattern->samplesPerPixel, threads);
+}
@@ -0,0 +1,15 @@
+#ifndef __SCENE_STATS_H
+#define __SCENE_STATS_H
+
+#include "Render.h"
+
+// print the number and memory use of each of the scene's containers (and its hierarchy and shadow maps), the triangles in each
+// of the scene file's models, and the mix of materials
+void reportSceneStats(const char* inputName, const Scene* scene);
+
+// trace a sample of the image's pixels (every sample of every eighth pixel along each axis, from a different starting pixel each
+// pass, for as many passes as it takes to be timed reliably) to estimate the rays cast per pixel and how long the image will take
+// the estimate is for tracing every sample of every pixel, with render time divided evenly between the threads
+void reportRenderEstimate(const Scene* scene, const RenderOptions* options, unsigned int threads);
+
+#endif // __SCENE_STATS_H
@@ -0,0 +1,218 @@
+#define NOMINMAX
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "SceneWatch.h"
+#include "Config.h"
+#include "TextureCache.h"
+
+// time (in ms) between checks of the scene file's modification time
+const DWORD SCENE_WATCH_POLL_MS = 250;
+
+// hash of each of a scene file's sections, by name
+struct SceneSections
+{
+	std::unordered_map<std::string, unsigned long long> hashes;
+};
+
+
+// modification time of a file (0 if it can't be read)
+static unsigned long long getLastWriteTime(const char* fileName)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(fileName, GetFileExInfoStandard, &data)) return 0;
+
+	return ((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+}
+
+
+// hash every section of a scene file (which has to have been loaded with SetSection already)
+static void hashSections(const Config& sceneFile, SceneSections* sections)
+{
+	sections->hashes.clear();
+	for (int i = 0; i < sceneFile.GetSectionCount(); ++i)
+		sections->hashes[sceneFile.GetSectionName(i)] = sceneFile.GetSectionHash(i);
+}
+
+
+// number of the object a section describes, if its name is the kind of object followed by a number below the count (e.g. "Light3")
+static bool getSectionObject(const char* name, const char* kind, unsigned int count, unsigned int* index)
+{
+	size_t length = strlen(kind);
+	if (strncmp(name, kind, length) != 0 || name[length] < '0' || name[length] > '9') return false;
+
+	char* end;
+	unsigned long number = strtoul(name + length, &end, 10);
+	if (*end != '\0' || number >= count) return false;
+
+	*index = (unsigned int)number;
+	return true;
+}
+
+
+// start watching a scene file, remembering its sections as they are now
+bool startSceneWatch(const char* inputName, SceneWatch* watch)
+{
+	watch->inputName = inputName;
+	watch->lastWrite = getLastWriteTime(inputName);
+	watch->numModels = 0;
+	watch->sections = new SceneSections;
+
+	Config sceneFile(inputName);
+	if (sceneFile.SetSection("Scene") == -1) return false;
+
+	watch->numModels = sceneFile.GetByNameAsInteger("NumberOfModels", 0);
+	hashSections(sceneFile, watch->sections);
+	return true;
+}
+
+
+// wait until the scene file has been saved again
+void waitForSceneEdit(SceneWatch* watch)
+{
+	unsigned long long lastWrite;
+	while ((lastWrite = getLastWriteTime(watch->inputName)) == watch->lastWrite || lastWrite == 0)
+		Sleep(SCENE_WATCH_POLL_MS);
+
+	// some editors save in more than one go, so wait until the file has stopped changing
+	for (;;)
+	{
+		Sleep(SCENE_WATCH_POLL_MS);
+
+		unsigned long long settled = getLastWriteTime(watch->inputName);
+		if (settled == lastWrite || settled == 0) break;
+		lastWrite = settled;
+	}
+
+	watch->lastWrite = lastWrite;
+}
+
+
+// re-read the watched scene file and update the scene's containers in place from the sections that have changed
+bool updateScene(SceneWatch* watch, Scene* scene, SceneChanges* changes)
+{
+	*changes = SceneChanges{ false, false, false, false, false };
+
+	Config sceneFile(watch->inputName);
+	if (sceneFile.SetSection("Scene") == -1)
+	{
+		fprintf(stderr, "Malformed Scene file: No Scene section.\n");
+		return false;
+	}
+
+	SceneSections* sections = new SceneSections;
+	hashSections(sceneFile, sections);
+
+	unsigned int numModels = sceneFile.GetByNameAsInteger("NumberOfModels", 0);
+
+	// a different number of objects means different sized containers, and a removed section has to be reported as missing, both of which init does
+	if (sceneFile.GetByNameAsInteger("NumberOfMaterials", 0) != (long)scene->numMaterials
+		|| sceneFile.GetByNameAsInteger("NumberOfSpheres", 0) != (long)scene->numSpheres
+		|| sceneFile.GetByNameAsInteger("NumberOfLights", 0) != (long)scene->numLights || numModels != watch->numModels)
+	{
+		changes->models = true;
+	}
+
+	for (const std::pair<const std::string, unsigned long long>& section : watch->sections->hashes)
+	{
+		if (sections->hashes.count(section.first) == 0) changes->models = true;
+	}
+
+	// read the edited sections into copies of their objects, so nothing changes unless they can all be read
+	Scene settings = *scene;
+	std::vector<std::pair<unsigned int, Material> > materials;
+	std::vector<std::pair<unsigned int, Sphere> > spheres;
+	std::vector<std::pair<unsigned int, Light> > lights;
+	bool valid = true;
+
+	for (int i = 0; i < sceneFile.GetSectionCount() && valid && !changes->models; ++i)
+	{
+		const char* name = sceneFile.GetSectionName(i);
+		std::unordered_map<std::string, unsigned long long>::const_iterator found = watch->sections->hashes.find(name);
+		if (found != watch->sections->hashes.end() && found->second == sceneFile.GetSectionHash(i)) continue;
+
+		// (sections that aren't part of the scene are ignored, as they are by init)
+		sceneFile.SetSection(name);
+		unsigned int index;
+
+		if (strcmp(name, "Scene") == 0)
+		{
+			changes->settings = true;
+			valid = GetSceneSettings(sceneFile, settings);
+		}
+		else if (getSectionObject(name, "Material", scene->numMaterials, &index))
+		{
+			changes->materials = true;
+			materials.push_back(std::make_pair(index, Material()));
+			valid = GetMaterial(sceneFile, materials.back().second);
+		}
+		else if (getSectionObject(name, "Sphere", scene->numSpheres, &index))
+		{
+			changes->spheres = true;
+			spheres.push_back(std::make_pair(index, Sphere()));
+			valid = GetSphere(sceneFile, *scene, spheres.back().second);
+		}
+		else if (getSectionObject(name, "Light", scene->numLights, &index))
+		{
+			changes->lights = true;
+			lights.push_back(std::make_pair(index, Light()));
+			GetLight(sceneFile, lights.back().second);
+		}
+		else if (getSectionObject(name, "Model", numModels, &index))
+		{
+			changes->models = true;
+		}
+	}
+
+	if (!valid)
+	{
+		delete sections;
+		return false;
+	}
+
+	// the next edit is compared with the file as it is now
+	delete watch->sections;
+	watch->sections = sections;
+	watch->numModels = numModels;
+
+	if (changes->models)
+	{
+		*changes = SceneChanges{ false, false, false, false, true };
+		return true;
+	}
+
+	if (changes->settings)
+	{
+		scene->cameraPosition = settings.cameraPosition;
+		scene->cameraRotation = settings.cameraRotation;
+		scene->cameraFieldOfView = settings.cameraFieldOfView;
+		scene->exposure = settings.exposure;
+		scene->skyboxMaterialId = settings.skyboxMaterialId;
+	}
+
+	// (the texture caches hang off the materials they bake)
+	if (changes->materials) destroyTextureCaches(scene);
+
+	for (size_t i = 0; i < materials.size(); ++i)
+		scene->materialContainer[materials[i].first] = materials[i].second;
+	for (size_t i = 0; i < spheres.size(); ++i)
+		scene->sphereContainer[spheres[i].first] = spheres[i].second;
+	for (size_t i = 0; i < lights.size(); ++i)
+		scene->lightContainer[lights[i].first] = lights[i].second;
+
+	return true;
+}
+
+
+// stop watching the scene file
+void stopSceneWatch(SceneWatch* watch)
+{
+	delete watch->sections;
+	watch->sections = NULL;
+}
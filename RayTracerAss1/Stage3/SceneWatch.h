@@ -0,0 +1,42 @@
+#ifndef __SCENE_WATCH_H
+#define __SCENE_WATCH_H
+
+#include "Scene.h"
+
+// kinds of section that have changed since a scene file was last read
+typedef struct SceneChanges
+{
+	bool settings;				// the camera, exposure or skybox
+	bool materials;
+	bool spheres;
+	bool lights;
+	bool models;				// a model, or the number of any kind of object (the scene has to be read again from scratch)
+} SceneChanges;
+
+// scene file being watched for edits, with what its sections were when it was last read
+typedef struct SceneWatch
+{
+	const char* inputName;
+	unsigned long long lastWrite;		// modification time of the file
+	unsigned int numModels;				// number of models (the scene itself doesn't keep count of them)
+	struct SceneSections* sections;		// hash of each section's contents, by name
+} SceneWatch;
+
+// start watching a scene file, remembering its sections as they are now (the scene should have just been read from it)
+// returns false if the file can't be read
+bool startSceneWatch(const char* inputName, SceneWatch* watch);
+
+// wait until the scene file has been saved again (checking its modification time a few times a second)
+void waitForSceneEdit(SceneWatch* watch);
+
+// re-read the watched scene file and update the scene's containers in place from the sections that have changed
+// when changes->models is set nothing is updated, as the scene has to be destroyed and read again from scratch
+// the texture caches are freed if a material changes, and whatever depends on the changed objects (the hierarchy, shadow maps and
+// texture caches) has to be rebuilt by the caller
+// returns false if the file can't be read or a changed section is malformed, in which case the scene is left untouched
+bool updateScene(SceneWatch* watch, Scene* scene, SceneChanges* changes);
+
+// stop watching the scene file
+void stopSceneWatch(SceneWatch* watch);
+
+#endif // __SCENE_WATCH_H
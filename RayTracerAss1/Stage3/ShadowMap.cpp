@@ -0,0 +1,175 @@
+#define NOMINMAX
+#include <windows.h>
+
+#include "ShadowMap.h"
+#include "Intersection.h"
+#include "Jobs.h"
+
+// number of shadow map texels either side of the looked up texel used for percentage closer filtering
+const int PCF_RADIUS = 1;
+
+// how far (in texels) points are pushed out along their normal before looking up the shadow map
+const float NORMAL_OFFSET = 1.0f;
+
+// limit on how steep a surface can be when working out the slope scaled bias (avoids huge biases at grazing angles)
+const float MAX_BIAS_SLOPE = 1.0f;
+
+// depth bias (in texels) applied to the comparison
+const float DEPTH_BIAS = 0.5f;
+
+
+// direction through a texel of a cube face (u and v run from -1 to 1 across the face)
+static Vector getFaceDirection(int face, float u, float v)
+{
+	Vector dir;
+
+	switch (face)
+	{
+	case 0: dir = { 1.0f, v, u }; break;
+	case 1: dir = { -1.0f, v, u }; break;
+	case 2: dir = { u, 1.0f, v }; break;
+	case 3: dir = { u, -1.0f, v }; break;
+	case 4: dir = { u, v, 1.0f }; break;
+	default: dir = { u, v, -1.0f }; break;
+	}
+
+	return dir;
+}
+
+
+// cube face and texel coordinates (as floats in the range 0 to resolution) a direction passes through
+static int getFaceCoordinates(const Vector& dir, unsigned int resolution, float* s, float* t)
+{
+	float ax = fabsf(dir.x), ay = fabsf(dir.y), az = fabsf(dir.z);
+	float u, v, major;
+	int face;
+
+	if (ax >= ay && ax >= az)
+	{
+		face = dir.x > 0.0f ? 0 : 1;
+		major = ax; u = dir.z; v = dir.y;
+	}
+	else if (ay >= az)
+	{
+		face = dir.y > 0.0f ? 2 : 3;
+		major = ay; u = dir.x; v = dir.z;
+	}
+	else
+	{
+		face = dir.z > 0.0f ? 4 : 5;
+		major = az; u = dir.x; v = dir.y;
+	}
+
+	*s = (u / major * 0.5f + 0.5f) * resolution;
+	*t = (v / major * 0.5f + 0.5f) * resolution;
+
+	return face;
+}
+
+
+// ray cast all six faces of a light's shadow map
+static void buildShadowMap(const Scene* scene, const Light* light, ShadowMap* shadowMap)
+{
+	const unsigned int resolution = shadowMap->resolution;
+	float* depth = shadowMap->depth;
+	Intersection intersect;
+
+	for (int face = 0; face < 6; ++face)
+	{
+		for (unsigned int t = 0; t < resolution; ++t)
+		{
+			for (unsigned int s = 0; s < resolution; ++s)
+			{
+				// ray through the centre of the texel
+				float u = (s + 0.5f) / resolution * 2.0f - 1.0f;
+				float v = (t + 0.5f) / resolution * 2.0f - 1.0f;
+				Ray ray = { light->pos, normalise(getFaceDirection(face, u, v)) };
+
+				*depth++ = objectIntersection(scene, &ray, &intersect) ? sqrtf((intersect.pos - light->pos).dot()) : MAX_RAY_DISTANCE;
+			}
+		}
+	}
+}
+
+
+// build the shadow map for one light
+static void buildShadowMapJob(void* data, unsigned int lightIndex, unsigned int thread)
+{
+	Scene* scene = (Scene*)data;
+	buildShadowMap(scene, &scene->lightContainer[lightIndex], &scene->shadowMapContainer[lightIndex]);
+}
+
+
+// ray cast a shadow map for every light in the scene, sharing the lights out between the given number of threads
+void buildShadowMaps(Scene* scene, unsigned int resolution, unsigned int threads)
+{
+	destroyShadowMaps(scene);
+
+	scene->shadowMapContainer = new ShadowMap[scene->numLights];
+	for (unsigned int i = 0; i < scene->numLights; ++i)
+	{
+		scene->shadowMapContainer[i].resolution = resolution;
+		scene->shadowMapContainer[i].depth = new float[6 * resolution * resolution];
+	}
+
+	runJobs(buildShadowMapJob, scene, scene->numLights, threads);
+}
+
+
+// free the scene's shadow maps (the scene goes back to using exact shadows)
+void destroyShadowMaps(Scene* scene)
+{
+	if (scene->shadowMapContainer == NULL) return;
+
+	for (unsigned int i = 0; i < scene->numLights; ++i)
+		delete[] scene->shadowMapContainer[i].depth;
+
+	delete[] scene->shadowMapContainer;
+	scene->shadowMapContainer = NULL;
+}
+
+
+// fraction of the light reaching a point, using percentage closer filtering of the light's shadow map
+// the point is pushed out along the surface normal by about a texel's width before the lookup ("normal offset"),
+// which stops surfaces shadowing themselves without the large depth biases that grazing angles would otherwise need
+float getShadowMapVisibility(const ShadowMap* shadowMap, const Light* light, const Point* pos, const Vector* normal, float lightDist)
+{
+	const int resolution = (int)shadowMap->resolution;
+
+	// size of a texel at this distance from the light (a texel covers about 2 / resolution radians)
+	float texelSize = lightDist * 2.0f / resolution;
+
+	// look up the map in the direction from the light to the offset point
+	Vector dir = (*pos + *normal * (texelSize * NORMAL_OFFSET)) - light->pos;
+	float dirLength = sqrtf(dir.dot());
+
+	// the surface's depth also changes across the filter footprint depending on its slope towards the light
+	float cosTheta = std::max(-(dir * *normal) / dirLength, 0.0f);
+	float slope = std::min(sqrtf(1.0f - cosTheta * cosTheta) / std::max(cosTheta, 1e-3f), MAX_BIAS_SLOPE);
+	float testDepth = dirLength - texelSize * (DEPTH_BIAS + slope * PCF_RADIUS) - EPSILON;
+
+	float s, t;
+	int face = getFaceCoordinates(dir, resolution, &s, &t);
+	const float* depth = shadowMap->depth + face * resolution * resolution;
+
+	int centreS = std::min((int)s, resolution - 1);
+	int centreT = std::min((int)t, resolution - 1);
+
+	int visible = 0, total = 0;
+
+	for (int dt = -PCF_RADIUS; dt <= PCF_RADIUS; ++dt)
+	{
+		// filtering is clamped to the edges of the face rather than wrapping onto its neighbours
+		int texelT = std::min(std::max(centreT + dt, 0), resolution - 1);
+
+		for (int ds = -PCF_RADIUS; ds <= PCF_RADIUS; ++ds)
+		{
+			int texelS = std::min(std::max(centreS + ds, 0), resolution - 1);
+
+			visible += depth[texelT * resolution + texelS] >= testDepth;
+			total++;
+		}
+	}
+
+	return float(visible) / total;
+}
@@ -0,0 +1,23 @@
+#ifndef __SHADOW_MAP_H
+#define __SHADOW_MAP_H
+
+#include "Scene.h"
+
+// cube of depth maps around a light, storing the distance to the closest object in each direction
+// used for approximate shadows in preview renders instead of tracing a shadow ray per light per hit
+typedef struct ShadowMap
+{
+	unsigned int resolution;	// width and height of each of the six cube faces
+	float* depth;				// distances, stored face by face, row by row
+} ShadowMap;
+
+// ray cast a shadow map for every light in the scene, sharing the lights out between the given number of threads
+void buildShadowMaps(Scene* scene, unsigned int resolution, unsigned int threads);
+
+// free the scene's shadow maps (the scene goes back to using exact shadows)
+void destroyShadowMaps(Scene* scene);
+
+// fraction of a light reaching a point (with the given surface normal), using percentage closer filtering of the light's shadow map
+float getShadowMapVisibility(const ShadowMap* shadowMap, const Light* light, const Point* pos, const Vector* normal, float lightDist);
+
+#endif // __SHADOW_MAP_H
@@ -0,0 +1,305 @@
+#define NOMINMAX
+#include <windows.h>
+#include <stdio.h>
+
+#include "TextureCache.h"
+#include "Texturing.h"
+
+// number of voxels across one unit of a material's texture (i.e. across one band of circles or wood)
+const float TEXTURE_CACHE_RESOLUTION = 32.0f;
+
+// voxels in a single brick
+const int TEXTURE_BRICK_VOXELS = TEXTURE_BRICK_SIZE * TEXTURE_BRICK_SIZE * TEXTURE_BRICK_SIZE;
+
+// memory used by all the caches, and the most they are allowed to use
+static volatile long long cacheBytes = 0;
+static long long cacheLimit = 0;
+
+// lookups (and lookups that found their brick already filled) over all threads
+static volatile long long totalLookups = 0;
+static volatile long long totalHits = 0;
+
+// lookups made by the current thread since its counts were last added to the totals
+static thread_local long long threadLookups = 0;
+static thread_local long long threadHits = 0;
+
+
+// bounds of all the objects using a material (returns false if nothing uses it)
+static bool getMaterialBounds(const Scene* scene, unsigned int materialId, Point* boundsMin, Point* boundsMax)
+{
+	bool found = false;
+
+	for (unsigned int i = 0; i < scene->numSpheres; ++i)
+	{
+		const Sphere* sphere = &scene->sphereContainer[i];
+		if (sphere->materialId != materialId) continue;
+
+		Point sphereMin = { sphere->pos.x - sphere->size, sphere->pos.y - sphere->size, sphere->pos.z - sphere->size };
+		Point sphereMax = { sphere->pos.x + sphere->size, sphere->pos.y + sphere->size, sphere->pos.z + sphere->size };
+		*boundsMin = found ? Point{ std::min(boundsMin->x, sphereMin.x), std::min(boundsMin->y, sphereMin.y), std::min(boundsMin->z, sphereMin.z) } : sphereMin;
+		*boundsMax = found ? Point{ std::max(boundsMax->x, sphereMax.x), std::max(boundsMax->y, sphereMax.y), std::max(boundsMax->z, sphereMax.z) } : sphereMax;
+		found = true;
+	}
+
+	for (unsigned int i = 0; i < scene->numTriangles; ++i)
+	{
+		const Triangle* triangle = &scene->triangleContainer[i];
+		if (triangle->materialId != materialId) continue;
+
+		const Point* points[3] = { &triangle->p1, &triangle->p2, &triangle->p3 };
+		for (int j = 0; j < 3; ++j)
+		{
+			*boundsMin = found ? Point{ std::min(boundsMin->x, points[j]->x), std::min(boundsMin->y, points[j]->y), std::min(boundsMin->z, points[j]->z) } : *points[j];
+			*boundsMax = found ? Point{ std::max(boundsMax->x, points[j]->x), std::max(boundsMax->y, points[j]->y), std::max(boundsMax->z, points[j]->z) } : *points[j];
+			found = true;
+		}
+	}
+
+	for (unsigned int m = 0; m < scene->numMeshes; ++m)
+	{
+		const Mesh* mesh = &scene->meshContainer[m];
+		if (mesh->materialId != materialId) continue;
+
+		for (unsigned int i = 0; i < mesh->numVertices; ++i)
+		{
+			const Point vertex = getMeshVertex(mesh, i);
+			const Point* point = &vertex;
+			*boundsMin = found ? Point{ std::min(boundsMin->x, point->x), std::min(boundsMin->y, point->y), std::min(boundsMin->z, point->z) } : *point;
+			*boundsMax = found ? Point{ std::max(boundsMax->x, point->x), std::max(boundsMax->y, point->y), std::max(boundsMax->z, point->z) } : *point;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+
+// set up (empty) caches for the scene's circles and wood materials, with the cache's total memory use limited to the given size
+void createTextureCaches(Scene* scene, size_t memoryLimit)
+{
+	destroyTextureCaches(scene);
+
+	cacheBytes = 0;
+	cacheLimit = memoryLimit;
+	totalLookups = 0;
+	totalHits = 0;
+
+	for (unsigned int m = 0; m < scene->numMaterials; ++m)
+	{
+		Material* material = &scene->materialContainer[m];
+
+		// checkerboards are cheaper to compute than to look up
+		if (material->type != Material::CIRCLES && material->type != Material::WOOD) continue;
+		if (material->size <= 0.0f) continue;
+
+		Point boundsMin, boundsMax;
+		if (!getMaterialBounds(scene, m, &boundsMin, &boundsMax)) continue;
+
+		// make the voxels bigger (and the cache blurrier) until the brick pointers take no more than a quarter of the memory limit
+		float voxelSize = material->size / TEXTURE_CACHE_RESOLUTION;
+		float brickWidth;
+		unsigned int bricksX, bricksY, bricksZ;
+		long long directoryBytes;
+
+		for (;;)
+		{
+			brickWidth = voxelSize * TEXTURE_BRICK_SIZE;
+			bricksX = (unsigned int)((boundsMax.x - boundsMin.x) / brickWidth) + 1;
+			bricksY = (unsigned int)((boundsMax.y - boundsMin.y) / brickWidth) + 1;
+			bricksZ = (unsigned int)((boundsMax.z - boundsMin.z) / brickWidth) + 1;
+			directoryBytes = (long long)bricksX * bricksY * bricksZ * sizeof(unsigned char*);
+
+			if (directoryBytes <= cacheLimit / 4) break;
+			voxelSize *= 2.0f;
+		}
+
+		if (voxelSize > material->size / TEXTURE_CACHE_RESOLUTION)
+		{
+			printf("Texture cache: material %u voxels enlarged to %g (from %g) to fit the memory limit\n", m, voxelSize, material->size / TEXTURE_CACHE_RESOLUTION);
+		}
+
+		TextureCache* cache = new TextureCache;
+		cache->material = material;
+		cache->origin = boundsMin;
+		cache->voxelSize = voxelSize;
+		cache->invVoxelSize = 1.0f / voxelSize;
+		cache->bricksX = bricksX;
+		cache->bricksY = bricksY;
+		cache->bricksZ = bricksZ;
+		cache->bricks = new unsigned char* volatile[bricksX * bricksY * bricksZ];
+
+		for (unsigned int i = 0; i < bricksX * bricksY * bricksZ; ++i)
+			cache->bricks[i] = NULL;
+
+		cacheBytes += directoryBytes;
+		material->textureCache = cache;
+	}
+}
+
+
+// free all of the scene's texture caches (materials go back to computing their textures directly)
+void destroyTextureCaches(Scene* scene)
+{
+	for (unsigned int m = 0; m < scene->numMaterials; ++m)
+	{
+		TextureCache* cache = scene->materialContainer[m].textureCache;
+		if (cache == NULL) continue;
+
+		for (unsigned int i = 0; i < cache->bricksX * cache->bricksY * cache->bricksZ; ++i)
+			delete[] cache->bricks[i];
+
+		delete[] cache->bricks;
+		delete cache;
+
+		scene->materialContainer[m].textureCache = NULL;
+	}
+}
+
+
+// empty the scene's texture caches and clear their lookup counts (call before each timed run, so every run starts from a cold cache)
+void resetTextureCaches(Scene* scene)
+{
+	for (unsigned int m = 0; m < scene->numMaterials; ++m)
+	{
+		TextureCache* cache = scene->materialContainer[m].textureCache;
+		if (cache == NULL) continue;
+
+		for (unsigned int i = 0; i < cache->bricksX * cache->bricksY * cache->bricksZ; ++i)
+		{
+			if (cache->bricks[i] == NULL) continue;
+
+			delete[] cache->bricks[i];
+			cache->bricks[i] = NULL;
+			cacheBytes -= TEXTURE_BRICK_VOXELS;
+		}
+	}
+
+	totalLookups = 0;
+	totalHits = 0;
+	threadLookups = 0;
+	threadHits = 0;
+}
+
+
+// bake a brick of the cache (returns NULL if there isn't enough memory left for it)
+// two threads can fill the same brick at once, in which case the first to finish is kept and the other thrown away
+static unsigned char* fillBrick(const TextureCache* cache, unsigned int brickIndex, int brickX, int brickY, int brickZ)
+{
+	if (InterlockedExchangeAdd64(&cacheBytes, TEXTURE_BRICK_VOXELS) + TEXTURE_BRICK_VOXELS > cacheLimit)
+	{
+		InterlockedExchangeAdd64(&cacheBytes, -TEXTURE_BRICK_VOXELS);
+		return NULL;
+	}
+
+	const Material* material = cache->material;
+	unsigned char* brick = new unsigned char[TEXTURE_BRICK_VOXELS];
+	unsigned char* voxel = brick;
+
+	// evaluate the texture at the voxel centres, a row of voxels (or part of one) per batch
+	for (int z = 0; z < TEXTURE_BRICK_SIZE; ++z)
+	{
+		for (int y = 0; y < TEXTURE_BRICK_SIZE; ++y)
+		{
+			for (int x = 0; x < TEXTURE_BRICK_SIZE; x += TEXTURE_BATCH)
+			{
+				float px[TEXTURE_BATCH], py[TEXTURE_BATCH], pz[TEXTURE_BATCH];
+				int which[TEXTURE_BATCH];
+
+				for (int k = 0; k < TEXTURE_BATCH; ++k)
+				{
+					px[k] = cache->origin.x + (brickX * TEXTURE_BRICK_SIZE + x + k + 0.5f) * cache->voxelSize;
+					py[k] = cache->origin.y + (brickY * TEXTURE_BRICK_SIZE + y + 0.5f) * cache->voxelSize;
+					pz[k] = cache->origin.z + (brickZ * TEXTURE_BRICK_SIZE + z + 0.5f) * cache->voxelSize;
+				}
+
+				if (material->type == Material::CIRCLES)
+					applyCirclesBatch(material, px, py, pz, which);
+				else
+					applyWoodBatch(material, px, py, pz, which);
+
+				for (int k = 0; k < TEXTURE_BATCH; ++k)
+					*voxel++ = (unsigned char)which[k];
+			}
+		}
+	}
+
+	unsigned char* existing = (unsigned char*)InterlockedCompareExchangePointer((PVOID volatile*)&cache->bricks[brickIndex], brick, NULL);
+	if (existing != NULL)
+	{
+		delete[] brick;
+		InterlockedExchangeAdd64(&cacheBytes, -TEXTURE_BRICK_VOXELS);
+		return existing;
+	}
+
+	return brick;
+}
+
+
+// which of the material's colours the texture gives at a point (1 for diffuse, 0 for diffuse2), filling the brick if needed
+// returns -1 if the point isn't (and can't be) cached, i.e. it's outside the grid or the memory limit has been reached
+int lookupTextureCache(const TextureCache* cache, const Point* pos)
+{
+	threadLookups++;
+
+	float fx = (pos->x - cache->origin.x) * cache->invVoxelSize;
+	float fy = (pos->y - cache->origin.y) * cache->invVoxelSize;
+	float fz = (pos->z - cache->origin.z) * cache->invVoxelSize;
+
+	if (fx < 0.0f || fy < 0.0f || fz < 0.0f) return -1;
+
+	unsigned int x = (unsigned int)fx, y = (unsigned int)fy, z = (unsigned int)fz;
+	unsigned int brickX = x / TEXTURE_BRICK_SIZE, brickY = y / TEXTURE_BRICK_SIZE, brickZ = z / TEXTURE_BRICK_SIZE;
+
+	if (brickX >= cache->bricksX || brickY >= cache->bricksY || brickZ >= cache->bricksZ) return -1;
+
+	unsigned int brickIndex = (brickZ * cache->bricksY + brickY) * cache->bricksX + brickX;
+	const unsigned char* brick = cache->bricks[brickIndex];
+
+	if (brick != NULL)
+	{
+		threadHits++;
+	}
+	else
+	{
+		brick = fillBrick(cache, brickIndex, brickX, brickY, brickZ);
+		if (brick == NULL) return -1;
+	}
+
+	x -= brickX * TEXTURE_BRICK_SIZE;
+	y -= brickY * TEXTURE_BRICK_SIZE;
+	z -= brickZ * TEXTURE_BRICK_SIZE;
+
+	return brick[(z * TEXTURE_BRICK_SIZE + y) * TEXTURE_BRICK_SIZE + x];
+}
+
+
+// add the calling thread's lookup counts to the totals (call as each render thread finishes)
+void flushTextureCacheStats()
+{
+	InterlockedExchangeAdd64(&totalLookups, threadLookups);
+	InterlockedExchangeAdd64(&totalHits, threadHits);
+
+	threadLookups = 0;
+	threadHits = 0;
+}
+
+
+// print memory use and hit rate of the scene's texture caches
+void reportTextureCaches(const Scene* scene)
+{
+	for (unsigned int m = 0; m < scene->numMaterials; ++m)
+	{
+		const TextureCache* cache = scene->materialContainer[m].textureCache;
+		if (cache == NULL) continue;
+
+		unsigned int numBricks = cache->bricksX * cache->bricksY * cache->bricksZ, filled = 0;
+		for (unsigned int i = 0; i < numBricks; ++i)
+			filled += cache->bricks[i] != NULL;
+
+		printf("Texture cache: material %u, %ux%ux%u bricks of %g voxels, %u filled (%.1fKB)\n", m, cache->bricksX, cache->bricksY, cache->bricksZ,
+			cache->voxelSize, filled, (filled * TEXTURE_BRICK_VOXELS + numBricks * sizeof(unsigned char*)) / 1024.0);
+	}
+
+	printf("Texture cache: %.2fMB used of %.2fMB, %lld lookups, %.2f%% hit rate\n", cacheBytes / (1024.0 * 1024.0), cacheLimit / (1024.0 * 1024.0),
+		totalLookups, totalLookups > 0 ? 100.0 * totalHits / totalLookups : 0.0);
+}
@@ -0,0 +1,41 @@
+#ifndef __TEXTURE_CACHE_H
+#define __TEXTURE_CACHE_H
+
+#include "Scene.h"
+
+// width, height and depth (in voxels) of a single brick of the cache
+const int TEXTURE_BRICK_SIZE = 8;
+
+// sparse voxel grid of a procedural texture, baked over the bounds of the objects using a material
+// the grid is split into bricks which are only allocated and filled (by whichever thread first needs them) when looked up
+// each voxel stores which of the material's colours the texture gives at the voxel's centre (1 for diffuse, 0 for diffuse2)
+typedef struct TextureCache
+{
+	const Material* material;			// material being cached
+	Point origin;						// corner of the grid
+	float voxelSize;					// width of a voxel
+	float invVoxelSize;					// reciprocal of the voxel width
+	unsigned int bricksX, bricksY, bricksZ;	// size of the grid in bricks
+	unsigned char* volatile* bricks;	// voxels of each brick (NULL until the brick is first used)
+} TextureCache;
+
+// set up (empty) caches for the scene's circles and wood materials, with the cache's total memory use limited to the given size
+// once the limit is reached, lookups of bricks that haven't already been filled compute the texture directly
+void createTextureCaches(Scene* scene, size_t memoryLimit);
+
+// free all of the scene's texture caches (materials go back to computing their textures directly)
+void destroyTextureCaches(Scene* scene);
+
+// empty the scene's texture caches and clear their lookup counts (call before each timed run, so every run starts from a cold cache)
+void resetTextureCaches(Scene* scene);
+
+// which of the material's colours the texture gives at a point (1 for diffuse, 0 for diffuse2), filling the brick if needed
+int lookupTextureCache(const TextureCache* cache, const Point* pos);
+
+// add the calling thread's lookup counts to the totals (call as each render thread finishes)
+void flushTextureCacheStats();
+
+// print memory use and hit rate of the scene's texture caches
+void reportTextureCaches(const Scene* scene);
+
+#endif // __TEXTURE_CACHE_H
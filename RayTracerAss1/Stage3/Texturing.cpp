@@ -1,6 +1,7 @@
 #include "Texturing.h"
 #include "Colour.h"
 #include "Intersection.h"
+#include "FastMath.h"
 
 // apply computed checkerboard texture
 Colour applyCheckerboard(const Intersection* intersect)
@@ -36,3 +37,54 @@ Colour applyWood(const Intersection* intersect)
 
 	return (which ? intersect->material->diffuse : intersect->material->diffuse2);
 }
+
+
+// ---- batched versions ----
+// these are written as fixed length loops over the batch with no branches or library calls, so they vectorise
+
+
+// apply computed checkerboard texture to a batch of points
+void applyCheckerboardBatch(const Material* material, const float* x, const float* y, const float* z, int* which)
+{
+	for (int i = 0; i < TEXTURE_BATCH; ++i)
+	{
+		float px = (x[i] - material->offset.x) / material->size;
+		float py = (y[i] - material->offset.y) / material->size;
+		float pz = (z[i] - material->offset.z) / material->size;
+
+		which[i] = (int(fastFloor(px)) + int(fastFloor(py)) + int(fastFloor(pz))) & 1;
+	}
+}
+
+
+// apply computed circular texture to a batch of points
+void applyCirclesBatch(const Material* material, const float* x, const float* y, const float* z, int* which)
+{
+	for (int i = 0; i < TEXTURE_BATCH; ++i)
+	{
+		float px = (x[i] - material->offset.x) / material->size;
+		float py = (y[i] - material->offset.y) / material->size;
+		float pz = (z[i] - material->offset.z) / material->size;
+
+		which[i] = int(fastFloor(sqrtf(px*px + py*py + pz*pz))) & 1;
+	}
+}
+
+
+// apply computed wood grain texture to a batch of points
+void applyWoodBatch(const Material* material, const float* x, const float* y, const float* z, int* which)
+{
+	for (int i = 0; i < TEXTURE_BATCH; ++i)
+	{
+		float px = (x[i] - material->offset.x) / material->size;
+		float py = (y[i] - material->offset.y) / material->size;
+		float pz = (z[i] - material->offset.z) / material->size;
+
+		// squiggle up where the point is
+		float qx = px * fastCos(py * 0.996f) * fastSin(pz * 1.023f);
+		float qy = fastCos(px) * py * fastSin(pz * 1.211f);
+		float qz = fastCos(px * 1.473f) * fastCos(py * 0.795f) * pz;
+
+		which[i] = int(fastFloor(sqrtf(qx*qx + qy*qy + qz*qz))) & 1;
+	}
+}
@@ -13,4 +13,14 @@ Colour applyCircles(const Intersection* intersect);
 // apply computed wood texture
 Colour applyWood(const Intersection* intersect);
 
+// number of points the batched texture functions evaluate at once
+const int TEXTURE_BATCH = 8;
+
+// batched versions of the textures above, for TEXTURE_BATCH points of the same material at once
+// they write which of the material's colours each point uses (1 for diffuse, 0 for diffuse2)
+// the scalar versions are the reference (wood uses approximate sin/cos here, so band edges can move slightly)
+void applyCheckerboardBatch(const Material* material, const float* x, const float* y, const float* z, int* which);
+void applyCirclesBatch(const Material* material, const float* x, const float* y, const float* z, int* which);
+void applyWoodBatch(const Material* material, const float* x, const float* y, const float* z, int* which);
+
 #endif // __TEXTURING_H
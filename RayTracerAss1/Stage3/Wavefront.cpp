@@ -0,0 +1,233 @@
+#include "Wavefront.h"
+#include <algorithm>
+
+// bits of each origin coordinate used in the sort keys (with the octant the key fits in the 32 bits above the path number)
+const int SORT_ORIGIN_BITS = 9;
+
+// allocate wavefront storage big enough for one tile
+void createWavefrontBuffer(WavefrontBuffer* wavefront, unsigned int blockSize, unsigned int samplesPerPixel)
+{
+	const unsigned int capacity = blockSize * blockSize * samplesPerPixel;
+
+	wavefront->pathCapacity = capacity;
+	wavefront->paths = new RayPath[capacity];
+	wavefront->queue = new unsigned int[capacity];
+	wavefront->nextQueue = new unsigned int[capacity];
+	wavefront->sortKeys = new unsigned long long[capacity];
+	wavefront->startX = new float[capacity];
+	wavefront->startY = new float[capacity];
+	wavefront->startZ = new float[capacity];
+	wavefront->dirX = new float[capacity];
+	wavefront->dirY = new float[capacity];
+	wavefront->dirZ = new float[capacity];
+	wavefront->t = new float[capacity];
+	wavefront->hitObject = new int[capacity];
+}
+
+
+// free wavefront storage
+void destroyWavefrontBuffer(WavefrontBuffer* wavefront)
+{
+	delete[] wavefront->paths;
+	delete[] wavefront->queue;
+	delete[] wavefront->nextQueue;
+	delete[] wavefront->sortKeys;
+	delete[] wavefront->startX;
+	delete[] wavefront->startY;
+	delete[] wavefront->startZ;
+	delete[] wavefront->dirX;
+	delete[] wavefront->dirY;
+	delete[] wavefront->dirZ;
+	delete[] wavefront->t;
+	delete[] wavefront->hitObject;
+}
+
+
+// spread the bits of a value out to every third bit (for interleaving three coordinates into a Morton code)
+static unsigned long long spreadBits(unsigned int value)
+{
+	unsigned long long bits = value & ((1 << SORT_ORIGIN_BITS) - 1);
+	bits = (bits | (bits << 16)) & 0x30000ff;
+	bits = (bits | (bits << 8)) & 0x300f00f;
+	bits = (bits | (bits << 4)) & 0x30c30c3;
+	bits = (bits | (bits << 2)) & 0x9249249;
+	return bits;
+}
+
+
+// reorder the queued paths so that rays going the same way from nearby points are traced together
+// rays are grouped by the octant of their direction, then ordered along a Morton curve through their origins (quantised over the bounds of the queue)
+static void sortQueue(WavefrontBuffer* wavefront, unsigned int count)
+{
+	if (count < 2) return;
+
+	Point boundsMin = wavefront->paths[wavefront->queue[0]].ray.start, boundsMax = boundsMin;
+	for (unsigned int i = 1; i < count; ++i)
+	{
+		const Point& start = wavefront->paths[wavefront->queue[i]].ray.start;
+		boundsMin = { std::min(boundsMin.x, start.x), std::min(boundsMin.y, start.y), std::min(boundsMin.z, start.z) };
+		boundsMax = { std::max(boundsMax.x, start.x), std::max(boundsMax.y, start.y), std::max(boundsMax.z, start.z) };
+	}
+
+	// scale from the bounds to the range of the quantised coordinates (flat bounds leave that axis out of the key)
+	const float cells = float((1 << SORT_ORIGIN_BITS) - 1);
+	const float scaleX = boundsMax.x > boundsMin.x ? cells / (boundsMax.x - boundsMin.x) : 0.0f;
+	const float scaleY = boundsMax.y > boundsMin.y ? cells / (boundsMax.y - boundsMin.y) : 0.0f;
+	const float scaleZ = boundsMax.z > boundsMin.z ? cells / (boundsMax.z - boundsMin.z) : 0.0f;
+
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		const Ray* ray = &wavefront->paths[wavefront->queue[i]].ray;
+
+		unsigned int octant = (ray->dir.x < 0.0f) | ((ray->dir.y < 0.0f) << 1) | ((ray->dir.z < 0.0f) << 2);
+		unsigned long long morton = spreadBits((unsigned int)((ray->start.x - boundsMin.x) * scaleX))
+			| (spreadBits((unsigned int)((ray->start.y - boundsMin.y) * scaleY)) << 1)
+			| (spreadBits((unsigned int)((ray->start.z - boundsMin.z) * scaleZ)) << 2);
+
+		// the path number sits in the low bits so it comes back out of the sorted keys
+		wavefront->sortKeys[i] = ((((unsigned long long)octant << (3 * SORT_ORIGIN_BITS)) | morton) << 32) | wavefront->queue[i];
+	}
+
+	std::sort(wavefront->sortKeys, wavefront->sortKeys + count);
+
+	for (unsigned int i = 0; i < count; ++i)
+		wavefront->queue[i] = (unsigned int)wavefront->sortKeys[i];
+}
+
+
+// intersect the rays of every queued path with the scene in one batch
+static void extendPaths(const Scene* scene, WavefrontBuffer* wavefront, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		const Ray* ray = &wavefront->paths[wavefront->queue[i]].ray;
+
+		wavefront->startX[i] = ray->start.x;
+		wavefront->startY[i] = ray->start.y;
+		wavefront->startZ[i] = ray->start.z;
+		wavefront->dirX[i] = ray->dir.x;
+		wavefront->dirY[i] = ray->dir.y;
+		wavefront->dirZ[i] = ray->dir.z;
+	}
+
+	objectIntersectionBatch(scene, count, wavefront->startX, wavefront->startY, wavefront->startZ,
+		wavefront->dirX, wavefront->dirY, wavefront->dirZ, wavefront->t, wavefront->hitObject);
+}
+
+
+// shade the hits of every queued path, and queue up the paths which carry on for the next bounce
+// returns the number of paths queued
+static unsigned int shadePaths(const Scene* scene, WavefrontBuffer* wavefront, unsigned int count)
+{
+	unsigned int nextCount = 0;
+
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		RayPath* path = &wavefront->paths[wavefront->queue[i]];
+		int object = wavefront->hitObject[i];
+
+		// missed everything
+		if (object < 0)
+		{
+			endPathAtSkybox(scene, path);
+			continue;
+		}
+
+		Intersection intersect;
+		setIntersectionObject(scene, object, &intersect);
+		intersect.pos = path->ray.start + path->ray.dir * wavefront->t[i];
+
+		calculateIntersectionResponse(scene, &path->ray, &intersect);
+
+		if (!shadePath(scene, path, &intersect)) continue;
+
+		// out of rays: the path finishes in the environment map
+		if (++path->level >= MAX_RAYS_CAST)
+		{
+			endPathAtSkybox(scene, path);
+			continue;
+		}
+
+		wavefront->nextQueue[nextCount++] = wavefront->queue[i];
+	}
+
+	return nextCount;
+}
+
+
+// render a single tile a bounce at a time (gives the same image as renderTile)
+void renderTileWavefront(const Scene* scene, const Camera* camera, const RenderOptions* options, const Tile* tile, int threadId, WavefrontBuffer* wavefront)
+{
+	const SamplePattern* pattern = &options->samplePattern;
+	const unsigned int samplesPerPixel = pattern->samplesPerPixel;
+	const float sampleRatio = 1.0f / samplesPerPixel;
+	unsigned int count = 0;
+
+	// start the paths of every sample in the tile
+	for (int py = tile->startY; py < tile->endY; py++)
+	{
+		int y = py - camera->centreY;
+
+		for (int x = tile->startX - camera->centreX; x < tile->endX - camera->centreX; x++)
+		{
+			const float* offsetX, * offsetY;
+			getPixelSamples(pattern, x, y, &offsetX, &offsetY);
+
+			for (unsigned int s = 0; s < samplesPerPixel; s++)
+			{
+				Ray viewRay = getCameraRay(camera, x + offsetX[s], y + offsetY[s]);
+				startPath(&wavefront->paths[count], &viewRay);
+				wavefront->queue[count] = count;
+				count++;
+			}
+		}
+	}
+
+	const unsigned int numPaths = count;
+
+	// extend all the paths, shade all their hits, and repeat with the paths which carry on
+	for (int bounce = 0; count > 0; ++bounce)
+	{
+		// drop the paths ended by the contribution cutoff or Russian roulette
+		unsigned int live = 0;
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			if (continuePath(options, &wavefront->paths[wavefront->queue[i]])) wavefront->queue[live++] = wavefront->queue[i];
+		}
+
+		// primary rays are already in a coherent order
+		if (options->sortRays && bounce > 0) sortQueue(wavefront, live);
+
+		extendPaths(scene, wavefront, live);
+		count = shadePaths(scene, wavefront, live);
+
+		unsigned int* swap = wavefront->queue;
+		wavefront->queue = wavefront->nextQueue;
+		wavefront->nextQueue = swap;
+	}
+
+	// sum each pixel's samples (in the order they were taken) and write them out
+	unsigned int path = 0;
+
+	for (int py = tile->startY; py < tile->endY; py++)
+	{
+		unsigned int* out = buffer + getImageIndex(options, tile->startX, py);
+
+		for (int px = tile->startX; px < tile->endX && path < numPaths; px++)
+		{
+			Colour output(0.0f, 0.0f, 0.0f);
+
+			for (unsigned int s = 0; s < samplesPerPixel; s++)
+			{
+				output += sampleRatio * wavefront->paths[path++].output;
+			}
+
+			//color rise processing
+			if (options->colourise) {
+				output.colourise(threadId % 7);
+			}
+
+			*out++ = output.convertToPixel(scene->exposure);
+		}
+	}
+}
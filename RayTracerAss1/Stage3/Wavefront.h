@@ -0,0 +1,34 @@
+#ifndef __WAVEFRONT_H
+#define __WAVEFRONT_H
+
+#include "Render.h"
+
+// per tile working space for wavefront path tracing
+// every sample's path in the tile is advanced one bounce at a time: all of the live paths are intersected in one batch,
+// then shaded, and those which carry on make up the queue for the next bounce
+typedef struct WavefrontBuffer
+{
+	unsigned int pathCapacity;		// maximum number of paths (samples) in a tile
+	RayPath* paths;					// path of each sample, in the order the samples are summed
+	unsigned int* queue;			// paths to be extended in the current bounce
+	unsigned int* nextQueue;		// paths which carry on to the next bounce
+	unsigned long long* sortKeys;	// direction octant and origin position of each queued ray (above the path number), for sorting
+
+	// rays of the current bounce (one per queued path), as separate arrays for the batched intersection tests
+	float* startX, * startY, * startZ;
+	float* dirX, * dirY, * dirZ;
+	float* t;						// distance to the closest hit
+	int* hitObject;					// object hit (see objectIntersectionBatch)
+} WavefrontBuffer;
+
+// allocate wavefront storage big enough for one tile
+void createWavefrontBuffer(WavefrontBuffer* wavefront, unsigned int blockSize, unsigned int samplesPerPixel);
+
+// free wavefront storage
+void destroyWavefrontBuffer(WavefrontBuffer* wavefront);
+
+// render a single tile a bounce at a time (gives the same image as renderTile)
+// with sortRays set, the reflection and refraction rays of each bounce are traced in order of direction and then origin
+void renderTileWavefront(const Scene* scene, const Camera* camera, const RenderOptions* options, const Tile* tile, int threadId, WavefrontBuffer* wavefront);
+
+#endif // __WAVEFRONT_H